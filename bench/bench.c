@@ -0,0 +1,1052 @@
+#define _GNU_SOURCE
+#include "array_hashmap.h"
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_LIST 16
+#define SWISS_MAX_LOAD 0.875
+#define CUCKOO_MAX_LOAD 0.97
+#define ZIPF_THETA_DEFAULT 0.99
+#define SEED_DEFAULT 1
+#define DURATION_DEFAULT 2
+#define ORDER_SIZE (1 << 18)
+#define EXPIRE_STEP_SLOTS 1024
+#define EXPIRE_AFTER 3600
+
+typedef enum dist { dist_uniform = 0, dist_zipf = 1 } dist_t;
+
+typedef enum format { format_csv = 0, format_json = 1 } format_t;
+
+typedef enum phase {
+    phase_insert,
+    phase_find_hit,
+    phase_find_lease,
+    phase_find_miss,
+    phase_update,
+    phase_upsert,
+    phase_delete,
+    phase_count
+} phase_t;
+
+typedef enum op { op_read = 0, op_write = 1, op_count = 2 } op_t;
+
+typedef struct layout {
+    const char *name;
+    int32_t flags;
+} layout_t;
+
+typedef struct workload {
+    const char *name;
+    int32_t read_percent;
+    array_hashmap_bool is_expire;
+} workload_t;
+
+typedef struct zipf {
+    int32_t n;
+    double theta;
+    double alpha;
+    double zetan;
+    double eta;
+} zipf_t;
+
+typedef struct config {
+    format_t format;
+    int32_t engine;
+    const layout_t *layout;
+    int32_t key_count;
+    int32_t value_size;
+    double load;
+    dist_t dist;
+    const zipf_t *zipf;
+    int32_t shard_count;
+    array_hashmap_bool is_optimistic;
+} config_t;
+
+typedef struct worker {
+    const config_t *config;
+    const workload_t *workload;
+    array_hashmap_t map_struct;
+    int32_t cpu;
+    uint64_t rng;
+    pthread_t thread;
+    uint64_t sum[op_count];
+    uint64_t max[op_count];
+    array_hashmap_latency_t latency;
+} worker_t;
+
+typedef struct touch {
+    int32_t value_size;
+    uint32_t stamp;
+} touch_t;
+
+typedef struct result {
+    int64_t ops;
+    double mops;
+    double mean_ns;
+    double p50_ns;
+    double p99_ns;
+    double p999_ns;
+    double max_ns;
+} result_t;
+
+const char *phase_names[phase_count] = { "insert", "find_hit", "find_lease", "find_miss",
+                                         "update", "upsert",   "delete" };
+const char *engine_names[3] = { "chain", "swiss", "cuckoo" };
+const char *dist_names[2] = { "uniform", "zipf" };
+const char *op_names[op_count] = { "read", "write" };
+const char *read_names[2] = { "locked", "optimistic" };
+
+const layout_t layouts_all[] = {
+    { "packed", 0 },
+    { "split", array_hashmap_opt_split_data },
+    { "packed_hash", array_hashmap_opt_store_hash },
+    { "split_hash", array_hashmap_opt_split_data | array_hashmap_opt_store_hash }
+};
+
+const workload_t workloads_all[] = { { "a", 50, 0 },
+                                     { "b", 95, 0 },
+                                     { "c", 100, 0 },
+                                     { "expire", 100, 1 } };
+
+uint64_t rng_state = SEED_DEFAULT;
+double ns_per_tick = 1.0;
+uint64_t timer_ticks = 0;
+int32_t results_count = 0;
+int32_t cpu_count = 1;
+array_hashmap_bool is_pin = 1;
+pthread_barrier_t start_barrier;
+volatile int32_t is_stop = 0;
+
+uint64_t *keys = NULL;
+uint64_t *keys_miss = NULL;
+int32_t *order = NULL;
+uint64_t *samples = NULL;
+char *elem = NULL;
+char *res_elem = NULL;
+
+void errmsg(const char *format, ...)
+{
+    va_list args;
+
+    fprintf(stderr, "Error: ");
+
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+
+    exit(EXIT_FAILURE);
+}
+
+uint64_t mix64(uint64_t z)
+{
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+uint64_t rng_next(uint64_t *state)
+{
+    return mix64(*state += 0x9e3779b97f4a7c15ULL);
+}
+
+double rng_double(uint64_t *state)
+{
+    return (rng_next(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+uint64_t ticks_now(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+#endif
+}
+
+double ns_now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+void ticks_calibrate(void)
+{
+    uint64_t ticks_start = 0;
+    double ns_start = 0;
+    int32_t i = 0;
+
+    /* The cost of the two reads around every op is subtracted from the samples */
+    timer_ticks = UINT64_MAX;
+    for (i = 0; i < 1000; i++) {
+        ticks_start = ticks_now();
+        ticks_start = ticks_now() - ticks_start;
+        if (ticks_start < timer_ticks) {
+            timer_ticks = ticks_start;
+        }
+    }
+
+    ticks_start = ticks_now();
+    ns_start = ns_now();
+    usleep(100000);
+    ns_per_tick = (ns_now() - ns_start) / (double)(ticks_now() - ticks_start);
+}
+
+void zipf_init(zipf_t *zipf, int32_t n, double theta)
+{
+    double zeta2 = 0;
+    int32_t i = 0;
+
+    zipf->n = n;
+    zipf->theta = theta;
+    zipf->alpha = 1.0 / (1.0 - theta);
+    zipf->zetan = 0;
+    for (i = 1; i <= n; i++) {
+        zipf->zetan += 1.0 / pow(i, theta);
+    }
+    zeta2 = 1.0 + 1.0 / pow(2, theta);
+    zipf->eta = (1.0 - pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / zipf->zetan);
+}
+
+int32_t zipf_next(const zipf_t *zipf, uint64_t *state)
+{
+    double u = 0;
+    double uz = 0;
+    int32_t rank = 0;
+
+    u = rng_double(state);
+    uz = u * zipf->zetan;
+    if (uz < 1.0) {
+        return 0;
+    }
+
+    if (uz < 1.0 + pow(0.5, zipf->theta)) {
+        return 1;
+    }
+
+    rank = (int32_t)(zipf->n * pow(zipf->eta * u - zipf->eta + 1.0, zipf->alpha));
+    return rank < zipf->n ? rank : zipf->n - 1;
+}
+
+void shuffle(int32_t *array, int32_t size, uint64_t *state)
+{
+    int32_t i = 0;
+    int32_t j = 0;
+    int32_t tmp = 0;
+
+    for (i = size - 1; i > 0; i--) {
+        j = (int32_t)(rng_next(state) % (uint64_t)(i + 1));
+        tmp = array[i];
+        array[i] = array[j];
+        array[j] = tmp;
+    }
+}
+
+array_hashmap_hash key_hash(const void *elem_data)
+{
+    uint64_t key = 0;
+
+    memcpy(&key, elem_data, sizeof(key));
+    return (array_hashmap_hash)(key ^ (key >> 32));
+}
+
+array_hashmap_bool key_cmp(const void *elem_data, const void *hashmap_elem_data)
+{
+    return !memcmp(elem_data, hashmap_elem_data, sizeof(uint64_t));
+}
+
+void value_touch(void *hashmap_elem_data, const void *add_elem_data, void *arg)
+{
+    touch_t *touch = (touch_t *)arg;
+
+    (void)add_elem_data;
+
+    /* Writes one field of the value, as a "last seen" update does */
+    if (touch->value_size >= (int32_t)sizeof(touch->stamp)) {
+        memcpy((char *)hashmap_elem_data + sizeof(uint64_t), &touch->stamp, sizeof(touch->stamp));
+    }
+    touch->stamp++;
+}
+
+int sample_cmp(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+void result_calc(result_t *result, int64_t ops, double wall_ns)
+{
+    uint64_t sum = 0;
+    int64_t i = 0;
+
+    qsort(samples, ops, sizeof(uint64_t), sample_cmp);
+    for (i = 0; i < ops; i++) {
+        sum += samples[i];
+    }
+
+    result->ops = ops;
+    result->mops = ops / wall_ns * 1e3;
+    result->mean_ns = (double)sum / ops * ns_per_tick;
+    result->p50_ns = samples[(ops - 1) * 50 / 100] * ns_per_tick;
+    result->p99_ns = samples[(ops - 1) * 99 / 100] * ns_per_tick;
+    result->p999_ns = samples[(ops - 1) * 999 / 1000] * ns_per_tick;
+    result->max_ns = samples[ops - 1] * ns_per_tick;
+}
+
+void result_print(const config_t *config, const char *workload, int32_t threads, int32_t thread,
+                  const char *phase, const result_t *result)
+{
+    if (config->format == format_csv) {
+        if (!results_count) {
+            printf("engine,layout,keys,value_size,load,dist,shards,reads,workload,threads,thread,"
+                   "phase,ops,mops,mean_ns,p50_ns,p99_ns,p999_ns,max_ns\n");
+        }
+        printf("%s,%s,%d,%d,%.2f,%s,%d,%s,%s,%d,%d,%s,%lld,%.3f,%.1f,%.1f,%.1f,%.1f,%.1f\n",
+               engine_names[config->engine], config->layout->name, config->key_count,
+               config->value_size, config->load, dist_names[config->dist], config->shard_count,
+               read_names[config->is_optimistic], workload, threads, thread, phase,
+               (long long)result->ops, result->mops, result->mean_ns, result->p50_ns,
+               result->p99_ns, result->p999_ns, result->max_ns);
+    } else {
+        printf("%s\n  {\"engine\": \"%s\", \"layout\": \"%s\", \"keys\": %d, \"value_size\": %d, "
+               "\"load\": %.2f, \"dist\": \"%s\", \"shards\": %d, \"reads\": \"%s\", "
+               "\"workload\": \"%s\", \"threads\": %d, \"thread\": %d, \"phase\": \"%s\", "
+               "\"ops\": %lld, \"mops\": %.3f, \"mean_ns\": %.1f, \"p50_ns\": %.1f, "
+               "\"p99_ns\": %.1f, \"p999_ns\": %.1f, \"max_ns\": %.1f}",
+               results_count ? "," : "[", engine_names[config->engine], config->layout->name,
+               config->key_count, config->value_size, config->load, dist_names[config->dist],
+               config->shard_count, read_names[config->is_optimistic], workload, threads, thread,
+               phase, (long long)result->ops, result->mops, result->mean_ns, result->p50_ns,
+               result->p99_ns, result->p999_ns, result->max_ns);
+    }
+
+    results_count++;
+    fflush(stdout);
+}
+
+int32_t parse_list(const char *arg, double *list)
+{
+    char *copy = NULL;
+    char *token = NULL;
+    int32_t count = 0;
+
+    copy = strdup(arg);
+    if (!copy) {
+        errmsg("No free memory for args\n");
+    }
+
+    for (token = strtok(copy, ","); token && count < MAX_LIST; token = strtok(NULL, ",")) {
+        list[count++] = strtod(token, NULL);
+    }
+
+    free(copy);
+    return count;
+}
+
+void usage(const char *name)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -k list   key counts (default 65536,1048576,4194304)\n"
+            "  -v list   value sizes in bytes (default 8,64)\n"
+            "  -l list   load factors (default 0.5,0.75,0.87)\n"
+            "  -e name   engine: chain, swiss, cuckoo or all (default all)\n"
+            "  -L list   layouts: packed, split, packed_hash, split_hash or all (default packed)\n"
+            "  -d name   lookup distribution: uniform or zipf (default uniform)\n"
+            "  -t theta  zipf skew (default %.2f)\n"
+            "  -s seed   random seed (default %d)\n"
+            "  -f name   output format: csv or json (default csv)\n"
+            "  -S count  shard count (default 0, one lock)\n"
+            "  -o        finds without the lock (array_hashmap_opt_optimistic_read), chain only\n"
+            "  -w list   mixed workloads instead of the phases: a (50%% reads), b (95%% reads),\n"
+            "            c (read only), expire (read only with a background expiry sweep) or all\n"
+            "  -T list   thread counts for the workloads (default 1,2,4,... up to the cpu count)\n"
+            "  -D secs   seconds per workload run (default %d)\n"
+            "  -P        don't pin threads to cpus\n",
+            name, ZIPF_THETA_DEFAULT, SEED_DEFAULT, DURATION_DEFAULT);
+    exit(EXIT_FAILURE);
+}
+
+array_hashmap_t map_new(const config_t *config, const workload_t *workload)
+{
+    array_hashmap_opts_t opts;
+    array_hashmap_t map_struct = NULL;
+
+    memset(&opts, 0, sizeof(opts));
+    opts.engine = config->engine;
+    opts.flags = config->layout->flags;
+    opts.shard_count = config->shard_count;
+    if (config->is_optimistic) {
+        opts.flags |= array_hashmap_opt_optimistic_read;
+    }
+    if (workload && workload->is_expire) {
+        opts.flags |= array_hashmap_opt_ttl;
+    }
+
+    map_struct = array_hashmap_init_opts(config->key_count / config->load, 1.0,
+                                         sizeof(uint64_t) + config->value_size, &opts);
+    if (map_struct == NULL) {
+        errmsg("Init error\n");
+    }
+
+    array_hashmap_set_func(map_struct, key_hash, key_cmp, key_hash, key_cmp, key_hash, key_cmp);
+
+    return map_struct;
+}
+
+void bench_run(const config_t *config)
+{
+    array_hashmap_t map_struct = NULL;
+    int32_t key_count = 0;
+    int32_t phase = 0;
+    int32_t i = 0;
+
+    array_hashmap_ret_t res = 0;
+    array_hashmap_ret_t expect = 0;
+    uint64_t key = 0;
+    uint64_t start = 0;
+    double wall_ns = 0;
+    array_hashmap_lease_t lease;
+    touch_t touch;
+    result_t result;
+
+    key_count = config->key_count;
+    touch.value_size = config->value_size;
+    touch.stamp = 0;
+    map_struct = map_new(config, NULL);
+
+    memset(elem, 0, sizeof(uint64_t) + config->value_size);
+    for (phase = 0; phase < phase_count; phase++) {
+        for (i = 0; i < key_count; i++) {
+            order[i] = i;
+        }
+        if (phase == phase_insert || phase == phase_delete || config->dist == dist_uniform) {
+            shuffle(order, key_count, &rng_state);
+        } else {
+            for (i = 0; i < key_count; i++) {
+                order[i] = zipf_next(config->zipf, &rng_state);
+            }
+        }
+
+        expect = array_hashmap_elem_finded;
+        if (phase == phase_insert) {
+            expect = array_hashmap_elem_added;
+        } else if (phase == phase_find_miss) {
+            expect = array_hashmap_elem_not_finded;
+        } else if (phase == phase_update || phase == phase_upsert) {
+            expect = array_hashmap_elem_already_in;
+        } else if (phase == phase_delete) {
+            expect = array_hashmap_elem_deled;
+        }
+
+        wall_ns = ns_now();
+        for (i = 0; i < key_count; i++) {
+            key = phase == phase_find_miss ? keys_miss[order[i]] : keys[order[i]];
+            memcpy(elem, &key, sizeof(key));
+
+            start = ticks_now();
+            switch (phase) {
+            case phase_insert:
+                res = array_hashmap_add_elem(map_struct, elem, NULL, array_hashmap_save_old_func);
+                break;
+            case phase_update:
+                res = array_hashmap_add_elem(map_struct, elem, NULL, array_hashmap_save_new_func);
+                break;
+            case phase_upsert:
+                res = array_hashmap_upsert(map_struct, elem, NULL, value_touch, &touch);
+                break;
+            case phase_find_lease:
+                res = array_hashmap_find_lease(map_struct, elem, &lease);
+                array_hashmap_lease_release(&lease);
+                break;
+            case phase_delete:
+                res = array_hashmap_del_elem(map_struct, elem, res_elem);
+                break;
+            default:
+                res = array_hashmap_find_elem(map_struct, elem, res_elem);
+                break;
+            }
+            samples[i] = ticks_now() - start;
+            samples[i] = samples[i] > timer_ticks ? samples[i] - timer_ticks : 0;
+
+            if (res != expect) {
+                errmsg("%s: unexpected result %d\n", phase_names[phase], res);
+            }
+        }
+        wall_ns = ns_now() - wall_ns;
+
+        result_calc(&result, key_count, wall_ns);
+        result_print(config, "phases", 1, 0, phase_names[phase], &result);
+    }
+
+    array_hashmap_del(&map_struct);
+}
+
+int32_t latency_bucket(uint64_t ticks)
+{
+    int32_t msb = 0;
+
+    /* Same buckets as the library, so the histograms merge with array_hashmap_latency_merge */
+    if (ticks < (1 << array_hashmap_latency_sub_bits)) {
+        return (int32_t)ticks;
+    }
+
+    msb = 63 - __builtin_clzll(ticks);
+
+    return ((msb - array_hashmap_latency_sub_bits + 1) << array_hashmap_latency_sub_bits) |
+           (int32_t)((ticks >> (msb - array_hashmap_latency_sub_bits)) &
+                     ((1 << array_hashmap_latency_sub_bits) - 1));
+}
+
+void pin_cpu(int32_t cpu)
+{
+    cpu_set_t set;
+
+    if (!is_pin) {
+        return;
+    }
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set)) {
+        errmsg("Can't pin thread to cpu %d\n", cpu);
+    }
+}
+
+void *worker_thread(void *arg)
+{
+    worker_t *worker = (worker_t *)arg;
+    const config_t *config = worker->config;
+    int32_t *indexes = NULL;
+    char *worker_elem = NULL;
+    char *worker_res = NULL;
+    int32_t elem_size = 0;
+    int32_t i = 0;
+
+    array_hashmap_ret_t res = 0;
+    array_hashmap_latency_op_t latency_op = 0;
+    op_t op = 0;
+    uint64_t key = 0;
+    uint64_t start = 0;
+    uint64_t ticks = 0;
+    uint64_t n = 0;
+
+    pin_cpu(worker->cpu);
+
+    /* Generated before the start so that the RNG and the Zipf math are not timed */
+    elem_size = sizeof(uint64_t) + config->value_size;
+    indexes = malloc(ORDER_SIZE * sizeof(int32_t));
+    worker_elem = calloc(1, elem_size);
+    worker_res = malloc(elem_size);
+    if (!indexes || !worker_elem || !worker_res) {
+        errmsg("No free memory for worker\n");
+    }
+
+    for (i = 0; i < ORDER_SIZE; i++) {
+        if (config->dist == dist_zipf) {
+            indexes[i] = zipf_next(config->zipf, &worker->rng);
+        } else {
+            indexes[i] = (int32_t)(rng_next(&worker->rng) % (uint64_t)config->key_count);
+        }
+    }
+
+    worker->latency.ns_per_tick = ns_per_tick;
+
+    pthread_barrier_wait(&start_barrier);
+
+    for (n = 0; !__atomic_load_n(&is_stop, __ATOMIC_RELAXED); n++) {
+        key = keys[indexes[n & (ORDER_SIZE - 1)]];
+        memcpy(worker_elem, &key, sizeof(key));
+
+        op = op_read;
+        if ((int32_t)(rng_next(&worker->rng) % 100) >= worker->workload->read_percent) {
+            op = op_write;
+        }
+
+        start = ticks_now();
+        if (op == op_read) {
+            res = array_hashmap_find_elem(worker->map_struct, worker_elem, worker_res);
+        } else {
+            res = array_hashmap_add_elem(worker->map_struct, worker_elem, NULL,
+                                         array_hashmap_save_new_func);
+        }
+        ticks = ticks_now() - start;
+        ticks = ticks > timer_ticks ? ticks - timer_ticks : 0;
+
+        if (res != (op == op_read ? array_hashmap_elem_finded : array_hashmap_elem_already_in)) {
+            errmsg("%s %s: unexpected result %d\n", worker->workload->name, op_names[op], res);
+        }
+
+        latency_op = op == op_read ? array_hashmap_latency_find : array_hashmap_latency_add;
+        worker->latency.buckets[latency_op][latency_bucket(ticks)]++;
+        worker->latency.count[latency_op]++;
+        worker->sum[op] += ticks;
+        if (ticks > worker->max[op]) {
+            worker->max[op] = ticks;
+        }
+    }
+
+    free(indexes);
+    free(worker_elem);
+    free(worker_res);
+
+    return NULL;
+}
+
+void *expire_thread(void *arg)
+{
+    array_hashmap_t map_struct = (array_hashmap_t)arg;
+    array_hashmap_cursor_t cursor;
+
+    /* Walks the map in write locked steps, as a server sweeping expired elements does */
+    array_hashmap_cursor_init(&cursor, 0, 1, 0);
+    pthread_barrier_wait(&start_barrier);
+
+    while (!__atomic_load_n(&is_stop, __ATOMIC_RELAXED)) {
+        array_hashmap_del_elem_by_func_step(map_struct, NULL, &cursor, EXPIRE_STEP_SLOTS);
+        if (array_hashmap_cursor_is_end(&cursor)) {
+            array_hashmap_cursor_init(&cursor, 0, 1, 0);
+        }
+    }
+
+    return NULL;
+}
+
+void result_from_latency(result_t *result, const array_hashmap_latency_t *latency, op_t op,
+                         uint64_t sum, uint64_t max, double wall_ns)
+{
+    array_hashmap_latency_op_t latency_op = 0;
+    uint64_t count = 0;
+
+    latency_op = op == op_read ? array_hashmap_latency_find : array_hashmap_latency_add;
+    count = latency->count[latency_op];
+
+    /* Percentiles are bucket upper bounds, at most 1/8 above the real value */
+    result->ops = count;
+    result->mops = count / wall_ns * 1e3;
+    result->mean_ns = count ? (double)sum / count * ns_per_tick : 0;
+    result->p50_ns = array_hashmap_latency_percentile(latency, latency_op, 50);
+    result->p99_ns = array_hashmap_latency_percentile(latency, latency_op, 99);
+    result->p999_ns = array_hashmap_latency_percentile(latency, latency_op, 99.9);
+    result->max_ns = max * ns_per_tick;
+}
+
+void bench_mixed(const config_t *config, const workload_t *workload, const int32_t *thread_counts,
+                 int32_t thread_counts_count, double duration)
+{
+    array_hashmap_t map_struct = NULL;
+    worker_t *workers = NULL;
+    pthread_t expire;
+    struct timespec sleep_for;
+    int32_t threads = 0;
+    int32_t t = 0;
+    int32_t i = 0;
+
+    array_hashmap_ret_t res = 0;
+    array_hashmap_latency_t total;
+    uint64_t sum[op_count];
+    uint64_t max[op_count];
+    double wall_ns = 0;
+    result_t result;
+    op_t op = 0;
+
+    /* Filled once and shared by all thread counts, the workloads only update existing keys */
+    map_struct = map_new(config, workload);
+
+    memset(elem, 0, sizeof(uint64_t) + config->value_size);
+    for (i = 0; i < config->key_count; i++) {
+        memcpy(elem, &keys[i], sizeof(uint64_t));
+        if (workload->is_expire) {
+            res = array_hashmap_add_elem_expire(map_struct, elem, NULL,
+                                                array_hashmap_save_old_func,
+                                                time(NULL) + EXPIRE_AFTER);
+        } else {
+            res = array_hashmap_add_elem(map_struct, elem, NULL, array_hashmap_save_old_func);
+        }
+
+        if (res != array_hashmap_elem_added) {
+            errmsg("%s preload: unexpected result %d\n", workload->name, res);
+        }
+    }
+
+    for (t = 0; t < thread_counts_count; t++) {
+        threads = thread_counts[t];
+
+        workers = calloc(threads, sizeof(worker_t));
+        if (!workers) {
+            errmsg("No free memory for workers\n");
+        }
+
+        if (pthread_barrier_init(&start_barrier, NULL, threads + 1 + workload->is_expire)) {
+            errmsg("Can't init barrier\n");
+        }
+        is_stop = 0;
+
+        for (i = 0; i < threads; i++) {
+            workers[i].config = config;
+            workers[i].workload = workload;
+            workers[i].map_struct = map_struct;
+            workers[i].cpu = i % cpu_count;
+            workers[i].rng = rng_next(&rng_state);
+            if (pthread_create(&workers[i].thread, NULL, worker_thread, &workers[i])) {
+                errmsg("Can't create thread\n");
+            }
+        }
+
+        if (workload->is_expire) {
+            if (pthread_create(&expire, NULL, expire_thread, (void *)map_struct)) {
+                errmsg("Can't create thread\n");
+            }
+        }
+
+        pthread_barrier_wait(&start_barrier);
+        wall_ns = ns_now();
+        sleep_for.tv_sec = (time_t)duration;
+        sleep_for.tv_nsec = (long)((duration - sleep_for.tv_sec) * 1e9);
+        while (nanosleep(&sleep_for, &sleep_for)) {
+        }
+        __atomic_store_n(&is_stop, 1, __ATOMIC_RELAXED);
+
+        for (i = 0; i < threads; i++) {
+            pthread_join(workers[i].thread, NULL);
+        }
+        wall_ns = ns_now() - wall_ns;
+
+        if (workload->is_expire) {
+            pthread_join(expire, NULL);
+        }
+
+        pthread_barrier_destroy(&start_barrier);
+
+        memset(&total, 0, sizeof(total));
+        memset(sum, 0, sizeof(sum));
+        memset(max, 0, sizeof(max));
+        for (i = 0; i < threads; i++) {
+            array_hashmap_latency_merge(&total, &workers[i].latency);
+            for (op = 0; op < op_count; op++) {
+                sum[op] += workers[i].sum[op];
+                if (workers[i].max[op] > max[op]) {
+                    max[op] = workers[i].max[op];
+                }
+            }
+        }
+
+        for (op = 0; op < op_count; op++) {
+            if (op == op_write && workload->read_percent == 100) {
+                continue;
+            }
+
+            for (i = 0; i < threads; i++) {
+                result_from_latency(&result, &workers[i].latency, op, workers[i].sum[op],
+                                    workers[i].max[op], wall_ns);
+                result_print(config, workload->name, threads, i, op_names[op], &result);
+            }
+
+            result_from_latency(&result, &total, op, sum[op], max[op], wall_ns);
+            result_print(config, workload->name, threads, -1, op_names[op], &result);
+        }
+
+        free(workers);
+    }
+
+    array_hashmap_del(&map_struct);
+}
+
+int32_t main(int32_t argc, char **argv)
+{
+    double key_counts[MAX_LIST] = { 1 << 16, 1 << 20, 1 << 22 };
+    double value_sizes[MAX_LIST] = { 8, 64 };
+    double loads[MAX_LIST] = { 0.5, 0.75, 0.87 };
+    int32_t key_counts_count = 3;
+    int32_t value_sizes_count = 2;
+    int32_t loads_count = 3;
+    int32_t engine_first = array_hashmap_engine_chain;
+    int32_t engine_last = array_hashmap_engine_cuckoo;
+    dist_t dist = dist_uniform;
+    double theta = ZIPF_THETA_DEFAULT;
+    double duration = DURATION_DEFAULT;
+    double thread_list[MAX_LIST];
+    int32_t thread_counts[MAX_LIST];
+    int32_t thread_counts_count = 0;
+    const layout_t *layouts[MAX_LIST];
+    int32_t layouts_count = 1;
+    int32_t layouts_all_count = sizeof(layouts_all) / sizeof(layouts_all[0]);
+    const workload_t *workloads[MAX_LIST];
+    int32_t workloads_count = 0;
+    int32_t workloads_all_count = sizeof(workloads_all) / sizeof(workloads_all[0]);
+    config_t config;
+
+    char *layout_names = NULL;
+    char *workload_names = NULL;
+    char *token = NULL;
+    array_hashmap_bool is_found = 0;
+    int32_t max_keys = 0;
+    int32_t max_value = 0;
+    int32_t engine = 0;
+    int32_t k = 0;
+    int32_t v = 0;
+    int32_t l = 0;
+    int32_t w = 0;
+    int32_t a = 0;
+    int32_t i = 0;
+    int opt = 0;
+    uint64_t key_base = 0;
+    zipf_t zipf;
+
+    memset(&config, 0, sizeof(config));
+    layouts[0] = &layouts_all[0];
+
+    cpu_count = (int32_t)sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpu_count < 1) {
+        cpu_count = 1;
+    }
+
+    while ((opt = getopt(argc, argv, "k:v:l:e:L:d:t:s:f:S:ow:T:D:Ph")) != -1) {
+        switch (opt) {
+        case 'k':
+            key_counts_count = parse_list(optarg, key_counts);
+            break;
+        case 'v':
+            value_sizes_count = parse_list(optarg, value_sizes);
+            break;
+        case 'l':
+            loads_count = parse_list(optarg, loads);
+            break;
+        case 'e':
+            if (!strcmp(optarg, "chain")) {
+                engine_last = array_hashmap_engine_chain;
+            } else if (!strcmp(optarg, "swiss")) {
+                engine_first = array_hashmap_engine_swiss;
+                engine_last = array_hashmap_engine_swiss;
+            } else if (!strcmp(optarg, "cuckoo")) {
+                engine_first = array_hashmap_engine_cuckoo;
+            } else if (strcmp(optarg, "all")) {
+                usage(argv[0]);
+            }
+            break;
+        case 'L':
+            layout_names = strdup(optarg);
+            if (!layout_names) {
+                errmsg("No free memory for args\n");
+            }
+
+            layouts_count = 0;
+            for (token = strtok(layout_names, ","); token; token = strtok(NULL, ",")) {
+                is_found = 0;
+                for (a = 0; a < layouts_all_count && layouts_count < MAX_LIST; a++) {
+                    if (!strcmp(token, "all") || !strcmp(token, layouts_all[a].name)) {
+                        layouts[layouts_count++] = &layouts_all[a];
+                        is_found = 1;
+                    }
+                }
+                if (!is_found) {
+                    usage(argv[0]);
+                }
+            }
+
+            free(layout_names);
+            break;
+        case 'd':
+            if (!strcmp(optarg, "zipf")) {
+                dist = dist_zipf;
+            } else if (strcmp(optarg, "uniform")) {
+                usage(argv[0]);
+            }
+            break;
+        case 't':
+            theta = strtod(optarg, NULL);
+            break;
+        case 's':
+            rng_state = strtoull(optarg, NULL, 10);
+            break;
+        case 'f':
+            if (!strcmp(optarg, "json")) {
+                config.format = format_json;
+            } else if (strcmp(optarg, "csv")) {
+                usage(argv[0]);
+            }
+            break;
+        case 'S':
+            config.shard_count = atoi(optarg);
+            break;
+        case 'o':
+            config.is_optimistic = 1;
+            break;
+        case 'w':
+            workload_names = strdup(optarg);
+            if (!workload_names) {
+                errmsg("No free memory for args\n");
+            }
+
+            workloads_count = 0;
+            for (token = strtok(workload_names, ","); token; token = strtok(NULL, ",")) {
+                is_found = 0;
+                for (w = 0; w < workloads_all_count && workloads_count < MAX_LIST; w++) {
+                    if (!strcmp(token, "all") || !strcmp(token, workloads_all[w].name)) {
+                        workloads[workloads_count++] = &workloads_all[w];
+                        is_found = 1;
+                    }
+                }
+                if (!is_found) {
+                    usage(argv[0]);
+                }
+            }
+
+            free(workload_names);
+            break;
+        case 'T':
+            thread_counts_count = parse_list(optarg, thread_list);
+            for (i = 0; i < thread_counts_count; i++) {
+                if (thread_list[i] < 1 || thread_list[i] > 4096) {
+                    errmsg("Bad thread count %g\n", thread_list[i]);
+                }
+                thread_counts[i] = (int32_t)thread_list[i];
+            }
+            break;
+        case 'D':
+            duration = strtod(optarg, NULL);
+            break;
+        case 'P':
+            is_pin = 0;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    if (theta <= 0 || theta >= 1) {
+        errmsg("Zipf theta must be in (0, 1)\n");
+    }
+
+    if (duration <= 0) {
+        errmsg("Bad duration %g\n", duration);
+    }
+
+    if (config.shard_count < 0 || config.shard_count > array_hashmap_max_shards) {
+        errmsg("Bad shard count %d\n", config.shard_count);
+    }
+
+    if (!thread_counts_count) {
+        for (i = 1; i < cpu_count && thread_counts_count < MAX_LIST - 1; i *= 2) {
+            thread_counts[thread_counts_count++] = i;
+        }
+        thread_counts[thread_counts_count++] = cpu_count;
+    }
+
+    for (k = 0; k < key_counts_count; k++) {
+        if (key_counts[k] < 1 || key_counts[k] > INT32_MAX / 2) {
+            errmsg("Bad key count %g\n", key_counts[k]);
+        }
+        if (key_counts[k] > max_keys) {
+            max_keys = (int32_t)key_counts[k];
+        }
+    }
+    for (v = 0; v < value_sizes_count; v++) {
+        if (value_sizes[v] < 0 || value_sizes[v] > 1 << 20) {
+            errmsg("Bad value size %g\n", value_sizes[v]);
+        }
+        if (value_sizes[v] > max_value) {
+            max_value = (int32_t)value_sizes[v];
+        }
+    }
+    for (l = 0; l < loads_count; l++) {
+        if (loads[l] <= 0 || loads[l] > 1) {
+            errmsg("Bad load factor %g\n", loads[l]);
+        }
+    }
+
+    keys = malloc(max_keys * sizeof(uint64_t));
+    keys_miss = malloc(max_keys * sizeof(uint64_t));
+    order = malloc(max_keys * sizeof(int32_t));
+    samples = malloc(max_keys * sizeof(uint64_t));
+    elem = malloc(sizeof(uint64_t) + max_value);
+    res_elem = malloc(sizeof(uint64_t) + max_value);
+    if (!keys || !keys_miss || !order || !samples || !elem || !res_elem) {
+        errmsg("No free memory for keys\n");
+    }
+
+    /* mix64 is a bijection, so all keys are distinct */
+    key_base = rng_next(&rng_state);
+    for (i = 0; i < max_keys; i++) {
+        keys[i] = mix64(key_base + (uint64_t)i * 0x9e3779b97f4a7c15ULL);
+        keys_miss[i] = mix64(key_base + (uint64_t)(i + max_keys) * 0x9e3779b97f4a7c15ULL);
+    }
+
+    ticks_calibrate();
+
+    config.dist = dist;
+    config.zipf = &zipf;
+
+    for (k = 0; k < key_counts_count; k++) {
+        if (dist == dist_zipf) {
+            zipf_init(&zipf, (int32_t)key_counts[k], theta);
+        }
+
+        for (engine = engine_first; engine <= engine_last; engine++) {
+            if (config.is_optimistic && engine != array_hashmap_engine_chain) {
+                continue;
+            }
+
+            for (v = 0; v < value_sizes_count; v++) {
+                for (l = 0; l < loads_count; l++) {
+                    if (engine == array_hashmap_engine_swiss && loads[l] > SWISS_MAX_LOAD) {
+                        continue;
+                    }
+                    if (engine == array_hashmap_engine_cuckoo && loads[l] > CUCKOO_MAX_LOAD) {
+                        continue;
+                    }
+
+                    config.engine = engine;
+                    config.key_count = (int32_t)key_counts[k];
+                    config.value_size = (int32_t)value_sizes[v];
+                    config.load = loads[l];
+
+                    for (a = 0; a < layouts_count; a++) {
+                        if (engine != array_hashmap_engine_chain &&
+                            (layouts[a]->flags & array_hashmap_opt_split_data)) {
+                            continue;
+                        }
+
+                        config.layout = layouts[a];
+
+                        if (!workloads_count) {
+                            bench_run(&config);
+                        }
+
+                        for (w = 0; w < workloads_count; w++) {
+                            bench_mixed(&config, workloads[w], thread_counts,
+                                        thread_counts_count, duration);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    if (config.format == format_json) {
+        printf("%s]\n", results_count ? "\n" : "[");
+    }
+
+    free(keys);
+    free(keys_miss);
+    free(order);
+    free(samples);
+    free(elem);
+    free(res_elem);
+
+    return EXIT_SUCCESS;
+}
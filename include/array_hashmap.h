@@ -1,8 +1,13 @@
 #ifndef __ARRAY_HASHMAP__
 #define __ARRAY_HASHMAP__
 
+#include <stddef.h>
 #include <stdint.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 #define array_hashmap_save_new 1
 #define array_hashmap_save_old 0
 #define array_hashmap_save_new_func (on_already_in_t)1
@@ -11,9 +16,39 @@
 #define array_hashmap_del_by_func 1
 #define array_hashmap_not_del_by_func 0
 
+#define array_hashmap_foreach_continue 1
+#define array_hashmap_foreach_stop 0
+
+#define array_hashmap_cursor_no_lock 0x1
+
+#define array_hashmap_max_shards 1024
+
+#define array_hashmap_stats_hist_size 16
+
+#define array_hashmap_latency_sub_bits 3
+#define array_hashmap_latency_buckets \
+    ((64 - array_hashmap_latency_sub_bits + 1) << array_hashmap_latency_sub_bits)
+
+#define array_hashmap_opt_grow 0x1
+#define array_hashmap_opt_shrink 0x2
+#define array_hashmap_opt_optimistic_read 0x4
+#define array_hashmap_opt_store_hash 0x8
+#define array_hashmap_opt_ttl 0x10
+#define array_hashmap_opt_huge_pages 0x20
+#define array_hashmap_opt_populate 0x40
+#define array_hashmap_opt_stats 0x80
+#define array_hashmap_opt_split_data 0x100
+#define array_hashmap_opt_str_key 0x200
+
+#define array_hashmap_str_inline_size 24
+#define array_hashmap_key_cstr (-1)
+
+#define array_hashmap_no_expire INT64_MAX
+
 typedef int32_t array_hashmap_bool;
 typedef uint32_t array_hashmap_hash;
 typedef int32_t array_hashmap_deled_count;
+typedef int64_t array_hashmap_time;
 typedef const void *array_hashmap_t;
 
 typedef array_hashmap_hash (*add_hash_t)(const void *add_elem_data);
@@ -25,6 +60,11 @@ typedef array_hashmap_bool (*del_cmp_t)(const void *del_elem_data, const void *h
 typedef array_hashmap_bool (*on_already_in_t)(const void *add_elem_data,
                                               const void *hashmap_elem_data);
 typedef array_hashmap_bool (*del_func_t)(const void *del_elem_data);
+typedef array_hashmap_bool (*foreach_func_t)(const void *elem_data, void *arg);
+typedef array_hashmap_time (*time_func_t)(void);
+typedef void (*upsert_func_t)(void *hashmap_elem_data, const void *add_elem_data, void *arg);
+typedef void *(*alloc_func_t)(size_t size, void *arg);
+typedef void (*free_func_t)(void *ptr, size_t size, void *arg);
 
 typedef enum array_hashmap_ret {
     array_hashmap_empty_args = -3,
@@ -38,21 +78,161 @@ typedef enum array_hashmap_ret {
     array_hashmap_elem_not_deled = 0
 } array_hashmap_ret_t;
 
+typedef enum array_hashmap_engine {
+    array_hashmap_engine_chain = 0,
+    array_hashmap_engine_swiss = 1,
+    array_hashmap_engine_cuckoo = 2
+} array_hashmap_engine_t;
+
+typedef enum array_hashmap_hash_func {
+    array_hashmap_hash_wy = 0,
+    array_hashmap_hash_crc32c = 1
+} array_hashmap_hash_func_t;
+
+typedef enum array_hashmap_latency_op {
+    array_hashmap_latency_add = 0,
+    array_hashmap_latency_find = 1,
+    array_hashmap_latency_del = 2,
+    array_hashmap_latency_read_lock = 3,
+    array_hashmap_latency_write_lock = 4,
+    array_hashmap_latency_ops = 5
+} array_hashmap_latency_op_t;
+
+typedef struct array_hashmap_opts {
+    int32_t flags;
+    int32_t migrate_step;
+    int32_t shard_count;
+    array_hashmap_engine_t engine;
+    alloc_func_t alloc_func;
+    free_func_t free_func;
+    void *alloc_arg;
+    array_hashmap_hash_func_t hash_func;
+    uint64_t seed;
+    int32_t key_size;
+} array_hashmap_opts_t;
+
+typedef struct array_hashmap_cursor {
+    int32_t part;
+    int32_t parts;
+    int32_t flags;
+    int32_t shard;
+    int32_t table;
+    int32_t index;
+} array_hashmap_cursor_t;
+
+typedef struct array_hashmap_lease {
+    array_hashmap_t map_struct;
+    const void *elem_data;
+    int32_t shard;
+} array_hashmap_lease_t;
+
+typedef struct array_hashmap_str {
+    array_hashmap_hash hash;
+    uint32_t len;
+    union {
+        char data[array_hashmap_str_inline_size];
+        const char *ptr;
+    } key;
+} array_hashmap_str_t;
+
+typedef struct array_hashmap_stats {
+    int32_t map_size;
+    int32_t now_in_map;
+    int32_t chain_count;
+    int32_t chain_hist[array_hashmap_stats_hist_size];
+    int32_t chain_max;
+    double chain_avg;
+    int32_t non_owner_count;
+    uint64_t add_cmp_calls;
+    uint64_t find_cmp_calls;
+    uint64_t del_cmp_calls;
+    uint64_t displacements;
+    uint64_t free_searches;
+    double free_search_avg;
+} array_hashmap_stats_t;
+
+typedef struct array_hashmap_latency {
+    double ns_per_tick;
+    uint64_t count[array_hashmap_latency_ops];
+    uint64_t buckets[array_hashmap_latency_ops][array_hashmap_latency_buckets];
+} array_hashmap_latency_t;
+
 array_hashmap_t array_hashmap_init(int32_t hashmap_size, double max_load, int32_t type_size);
+array_hashmap_t array_hashmap_init_opts(int32_t hashmap_size, double max_load, int32_t type_size,
+                                        const array_hashmap_opts_t *opts);
 void array_hashmap_del(array_hashmap_t *);
 
 void array_hashmap_set_func(array_hashmap_t, add_hash_t, add_cmp_t, find_hash_t, find_cmp_t,
                             del_hash_t, del_cmp_t);
+void array_hashmap_set_time_func(array_hashmap_t, time_func_t);
+
+array_hashmap_hash array_hashmap_hash_bytes(array_hashmap_t, const void *data, size_t len);
+array_hashmap_hash array_hashmap_hash_str(array_hashmap_t, const char *str);
+array_hashmap_hash array_hashmap_hash_seed(array_hashmap_hash_func_t hash_func, uint64_t seed,
+                                           const void *data, size_t len);
+
+void array_hashmap_str_set(array_hashmap_t, array_hashmap_str_t *str, const char *key,
+                           uint32_t len);
+const char *array_hashmap_str_key(const array_hashmap_str_t *str);
 
 int32_t array_hashmap_now_in_map(array_hashmap_t map_struct_c);
+int32_t array_hashmap_map_size(array_hashmap_t map_struct_c);
 array_hashmap_bool array_hashmap_is_thread_safety(array_hashmap_t map_struct_c);
+array_hashmap_bool array_hashmap_get_stats(array_hashmap_t map_struct_c,
+                                           array_hashmap_stats_t *stats);
+array_hashmap_bool array_hashmap_get_latency(array_hashmap_t map_struct_c,
+                                             array_hashmap_latency_t *latency);
+void array_hashmap_latency_merge(array_hashmap_latency_t *to, const array_hashmap_latency_t *from);
+uint64_t array_hashmap_latency_percentile(const array_hashmap_latency_t *latency,
+                                          array_hashmap_latency_op_t op, double percentile);
 
 array_hashmap_ret_t array_hashmap_add_elem(array_hashmap_t, const void *add_elem_data,
                                            void *res_elem_data, on_already_in_t);
+array_hashmap_ret_t array_hashmap_add_elem_expire(array_hashmap_t, const void *add_elem_data,
+                                                  void *res_elem_data, on_already_in_t,
+                                                  array_hashmap_time expire);
+array_hashmap_ret_t array_hashmap_upsert(array_hashmap_t, const void *add_elem_data,
+                                         upsert_func_t init_func, upsert_func_t update_func,
+                                         void *arg);
+array_hashmap_ret_t array_hashmap_upsert_expire(array_hashmap_t, const void *add_elem_data,
+                                                upsert_func_t init_func, upsert_func_t update_func,
+                                                void *arg, array_hashmap_time expire);
 array_hashmap_ret_t array_hashmap_find_elem(array_hashmap_t, const void *find_elem_data,
                                             void *res_elem_data);
+int32_t array_hashmap_find_batch(array_hashmap_t, const void *const *find_elems_data,
+                                 int32_t count, void *res_elems_data,
+                                 array_hashmap_ret_t *find_res);
+array_hashmap_ret_t array_hashmap_find_lease(array_hashmap_t, const void *find_elem_data,
+                                             array_hashmap_lease_t *lease);
+void array_hashmap_lease_release(array_hashmap_lease_t *lease);
 array_hashmap_ret_t array_hashmap_del_elem(array_hashmap_t, const void *del_elem_data,
                                            void *res_elem_data);
 array_hashmap_deled_count array_hashmap_del_elem_by_func(array_hashmap_t, del_func_t);
+array_hashmap_deled_count array_hashmap_del_elem_by_func_parallel(array_hashmap_t, del_func_t,
+                                                                  int32_t thread_count);
+
+array_hashmap_bool array_hashmap_cursor_init(array_hashmap_cursor_t *cursor, int32_t part,
+                                             int32_t parts, int32_t flags);
+array_hashmap_bool array_hashmap_cursor_is_end(const array_hashmap_cursor_t *cursor);
+array_hashmap_deled_count array_hashmap_del_elem_by_func_step(array_hashmap_t, del_func_t,
+                                                              array_hashmap_cursor_t *cursor,
+                                                              int32_t max_slots);
+int32_t array_hashmap_foreach_step(array_hashmap_t, array_hashmap_cursor_t *cursor,
+                                   int32_t max_slots, foreach_func_t, void *arg);
+int32_t array_hashmap_foreach_part(array_hashmap_t, int32_t part, int32_t parts, foreach_func_t,
+                                   void *arg);
+int32_t array_hashmap_foreach(array_hashmap_t, foreach_func_t, void *arg);
+
+array_hashmap_bool array_hashmap_save(array_hashmap_t, const char *path, uint32_t hash_id);
+array_hashmap_t array_hashmap_open_mmap(const char *path, uint32_t hash_id);
+array_hashmap_t array_hashmap_open_mmap_checked(const char *path, uint32_t hash_id);
+
+array_hashmap_t array_hashmap_init_shared(const char *name, int32_t hashmap_size, double max_load,
+                                          int32_t type_size, const array_hashmap_opts_t *opts);
+array_hashmap_t array_hashmap_attach_shared(const char *name);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif
@@ -0,0 +1,304 @@
+#ifndef __ARRAY_HASHMAP_HPP__
+#define __ARRAY_HASHMAP_HPP__
+
+#include "array_hashmap.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+template <typename Key, typename Value, typename Hash = std::hash<Key>,
+          typename Eq = std::equal_to<Key>>
+class array_hashmap {
+    static_assert(std::is_nothrow_move_constructible<Key>::value &&
+                      std::is_nothrow_move_constructible<Value>::value,
+                  "array_hashmap: Key and Value must be nothrow move constructible");
+
+public:
+    array_hashmap(int32_t map_size, double max_load, const Hash &hash = Hash(),
+                  const Eq &eq = Eq())
+        : map(nullptr), map_size(map_size), max_size(0), now_in_map(0), hash(hash), eq(eq)
+    {
+        if (map_size <= 0 || max_load <= 0 || max_load > 1.0) {
+            throw std::invalid_argument("array_hashmap: bad size or max_load");
+        }
+
+        map = new elem_t[map_size];
+        max_size = map_size * max_load;
+    }
+
+    ~array_hashmap()
+    {
+        for (int32_t i = 0; i < map_size; i++) {
+            if (map[i].next != elem_empty) {
+                map[i].kv.~kv_t();
+            }
+        }
+        delete[] map;
+    }
+
+    array_hashmap(const array_hashmap &) = delete;
+    array_hashmap &operator=(const array_hashmap &) = delete;
+
+    template <typename K, typename V>
+    array_hashmap_ret_t add_elem(K &&key, V &&value)
+    {
+        return add_elem(std::forward<K>(key), std::forward<V>(value),
+                        [](const Value &, const Value &) { return false; });
+    }
+
+    template <typename K, typename V, typename OnAlreadyIn>
+    array_hashmap_ret_t add_elem(K &&key, V &&value, OnAlreadyIn on_already_in)
+    {
+        int32_t add_elem_index = index_key(key);
+        elem_t *check_elem = &map[add_elem_index];
+
+        if (check_elem->next == elem_empty) {
+            if (now_in_map >= max_size) {
+                return array_hashmap_full;
+            }
+
+            elem_set(check_elem, elem_last, std::forward<K>(key), std::forward<V>(value));
+            return array_hashmap_elem_added;
+        }
+
+        int32_t check_elem_index = index_key(check_elem->kv.first);
+        if (check_elem_index != add_elem_index) {
+            if (now_in_map >= max_size) {
+                return array_hashmap_full;
+            }
+
+            displace(add_elem_index, check_elem_index);
+            elem_set(check_elem, elem_last, std::forward<K>(key), std::forward<V>(value));
+            return array_hashmap_elem_added;
+        }
+
+        int32_t list_elem_index = add_elem_index;
+        elem_t *list_elem = nullptr;
+        do {
+            list_elem = &map[list_elem_index];
+            if (eq(key, list_elem->kv.first)) {
+                if (on_already_in(static_cast<const Value &>(value), list_elem->kv.second)) {
+                    list_elem->kv.second = std::forward<V>(value);
+                }
+                return array_hashmap_elem_already_in;
+            }
+            list_elem_index = list_elem->next;
+        } while (list_elem_index != elem_last);
+
+        if (now_in_map >= max_size) {
+            return array_hashmap_full;
+        }
+
+        int32_t new_elem_index = free_index(add_elem_index);
+        elem_set(&map[new_elem_index], elem_last, std::forward<K>(key), std::forward<V>(value));
+        list_elem->next = new_elem_index;
+        return array_hashmap_elem_added;
+    }
+
+    Value *find_elem(const Key &key)
+    {
+        int32_t list_elem_index = index_key(key);
+
+        if (map[list_elem_index].next == elem_empty) {
+            return nullptr;
+        }
+
+        while (list_elem_index != elem_last) {
+            elem_t *list_elem = &map[list_elem_index];
+            if (eq(key, list_elem->kv.first)) {
+                return &list_elem->kv.second;
+            }
+            list_elem_index = list_elem->next;
+        }
+
+        return nullptr;
+    }
+
+    const Value *find_elem(const Key &key) const
+    {
+        return const_cast<array_hashmap *>(this)->find_elem(key);
+    }
+
+    array_hashmap_ret_t del_elem(const Key &key, Value *res_value = nullptr)
+    {
+        int32_t list_elem_index = index_key(key);
+        int32_t list_prev_elem_index = elem_last;
+
+        if (map[list_elem_index].next == elem_empty) {
+            return array_hashmap_elem_not_deled;
+        }
+
+        while (list_elem_index != elem_last) {
+            elem_t *list_elem = &map[list_elem_index];
+            if (eq(key, list_elem->kv.first)) {
+                if (res_value) {
+                    *res_value = std::move(list_elem->kv.second);
+                }
+                unlink(list_prev_elem_index, list_elem_index);
+                return array_hashmap_elem_deled;
+            }
+            list_prev_elem_index = list_elem_index;
+            list_elem_index = list_elem->next;
+        }
+
+        return array_hashmap_elem_not_deled;
+    }
+
+    template <typename DelFunc>
+    array_hashmap_deled_count del_elem_by_func(DelFunc del_func)
+    {
+        array_hashmap_deled_count del_count = 0;
+
+        for (int32_t i = 0; i < map_size; i++) {
+            if (map[i].next == elem_empty || index_key(map[i].kv.first) != i) {
+                continue;
+            }
+
+            int32_t list_prev_elem_index = elem_last;
+            int32_t list_elem_index = i;
+            while (list_elem_index != elem_last) {
+                elem_t *list_elem = &map[list_elem_index];
+                if (del_func(static_cast<const Key &>(list_elem->kv.first),
+                             static_cast<const Value &>(list_elem->kv.second))) {
+                    bool is_last = list_elem->next == elem_last;
+
+                    unlink(list_prev_elem_index, list_elem_index);
+                    if (is_last) {
+                        list_elem_index = elem_last;
+                    }
+
+                    del_count++;
+                } else {
+                    list_prev_elem_index = list_elem_index;
+                    list_elem_index = list_elem->next;
+                }
+            }
+        }
+
+        return del_count;
+    }
+
+    int32_t get_now_in_map() const
+    {
+        return now_in_map;
+    }
+
+    int32_t get_map_size() const
+    {
+        return map_size;
+    }
+
+private:
+    typedef std::pair<Key, Value> kv_t;
+
+    enum next { elem_empty = -2, elem_last = -1 };
+
+    struct elem_t {
+        int32_t next;
+        union {
+            kv_t kv;
+        };
+
+        elem_t() : next(elem_empty)
+        {
+        }
+
+        ~elem_t()
+        {
+        }
+    };
+
+    elem_t *map;
+    int32_t map_size;
+    int32_t max_size;
+    int32_t now_in_map;
+    Hash hash;
+    Eq eq;
+
+    static array_hashmap_hash hash_mix(uint64_t full_hash)
+    {
+        array_hashmap_hash mixed = static_cast<array_hashmap_hash>(full_hash ^ (full_hash >> 32));
+
+        mixed ^= mixed >> 16;
+        mixed *= 0x85ebca6b;
+        mixed ^= mixed >> 13;
+        mixed *= 0xc2b2ae35;
+        mixed ^= mixed >> 16;
+
+        return mixed;
+    }
+
+    int32_t index_key(const Key &key) const
+    {
+        return static_cast<int32_t>(
+            (static_cast<uint64_t>(hash_mix(hash(key))) * static_cast<uint32_t>(map_size)) >> 32);
+    }
+
+    int32_t free_index(int32_t index) const
+    {
+        do {
+            index++;
+            if (index == map_size) {
+                index = 0;
+            }
+        } while (map[index].next != elem_empty);
+
+        return index;
+    }
+
+    template <typename K, typename V>
+    void elem_set(elem_t *elem, int32_t next, K &&key, V &&value)
+    {
+        new (&elem->kv) kv_t(std::forward<K>(key), std::forward<V>(value));
+        elem->next = next;
+        now_in_map++;
+    }
+
+    /* Leaves from empty, so a throwing elem_set into it does not destroy the moved kv twice */
+    void elem_move(elem_t *to, elem_t *from)
+    {
+        new (&to->kv) kv_t(std::move(from->kv));
+        from->kv.~kv_t();
+        to->next = from->next;
+        from->next = elem_empty;
+    }
+
+    void displace(int32_t add_elem_index, int32_t check_elem_index)
+    {
+        elem_t *list_elem = &map[check_elem_index];
+        while (list_elem->next != add_elem_index) {
+            list_elem = &map[list_elem->next];
+        }
+
+        int32_t new_elem_index = free_index(add_elem_index);
+        elem_move(&map[new_elem_index], &map[add_elem_index]);
+        list_elem->next = new_elem_index;
+    }
+
+    void unlink(int32_t list_prev_elem_index, int32_t list_elem_index)
+    {
+        elem_t *list_elem = &map[list_elem_index];
+
+        if (list_elem->next == elem_last) {
+            if (list_prev_elem_index != elem_last) {
+                map[list_prev_elem_index].next = elem_last;
+            }
+            list_elem->kv.~kv_t();
+            list_elem->next = elem_empty;
+        } else {
+            elem_t *list_next_elem = &map[list_elem->next];
+
+            list_elem->kv.~kv_t();
+            list_elem->next = elem_empty;
+            elem_move(list_elem, list_next_elem);
+        }
+
+        now_in_map--;
+    }
+};
+
+#endif
@@ -1,528 +1,2293 @@
-#include "array_hashmap.h"
-#ifdef THREAD_SAFETY
-#include <pthread.h>
-#endif
+#include "array_hashmap_internal.h"
+#include <fcntl.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 
-typedef struct hashmap {
-    char *map;
+#define MIGRATE_STEP_DEFAULT 64
+#define OPTIMISTIC_READ_TRIES 4
+#define PURGE_DELETED_PART 16
+#define EXPIRE_SCAN_SLOTS 1024
+#define FIND_BATCH 32
+#define PAGE_ALIGN 4096
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+#define SNAPSHOT_MAGIC "ARHMAP3"
+#define SHARED_MAGIC "ARHMSH3"
+
+typedef struct snapshot_header {
+    char magic[8];
+    uint32_t hash_id;
+    int32_t engine;
+    int32_t flags;
+    int32_t migrate_step;
+    int32_t shard_count;
+    int32_t min_map_size;
+    int32_t data_size;
+    int32_t elem_size;
+    int32_t hash_func;
+    int32_t key_size;
+    uint64_t seed;
+    double max_load;
+    uint64_t checksum;
+} snapshot_header_t;
+
+typedef struct snapshot_table {
+    int64_t offset;
+    int64_t ctrl_offset;
     int32_t map_size;
     int32_t max_size;
     int32_t now_in_map;
-    int32_t elem_size;
+    int32_t deleted;
+    uint32_t table_checksum;
+} snapshot_table_t;
+
+typedef struct shared_header {
+    char magic[8];
+    char *base;
+    size_t size;
+    int32_t shard_size;
+    int32_t engine;
+    int32_t flags;
+    int32_t migrate_step;
+    int32_t shard_count;
+    int32_t min_map_size;
     int32_t data_size;
-    add_hash_t add_hash;
-    add_cmp_t add_cmp;
-    find_hash_t find_hash;
-    find_cmp_t find_cmp;
-    del_hash_t del_hash;
-    del_cmp_t del_cmp;
-    array_hashmap_bool is_thread_safety;
+    int32_t elem_size;
+    int32_t hash_func;
+    int32_t key_size;
+    uint64_t seed;
+    double max_load;
+    int32_t is_ready;
+} shared_header_t;
+
 #ifdef THREAD_SAFETY
-    pthread_rwlock_t rwlock;
+typedef struct sweep_part {
+    hashmap_t *map_struct;
+    table_t table;
+    del_func_t del_func;
+    uint8_t *marks;
+    int32_t from;
+    int32_t to;
+    int32_t del_count;
+    array_hashmap_bool is_thread;
+    pthread_t thread;
+} sweep_part_t;
 #endif
-} hashmap_t;
 
-typedef struct __attribute__((packed)) elem {
-    int32_t next;
-    char data;
-} elem_t;
+#define page_align(size) (((size) + PAGE_ALIGN - 1) / PAGE_ALIGN * PAGE_ALIGN)
+#define shared_shards_offset                                                           \
+    ((sizeof(shared_header_t) + __alignof__(shard_t) - 1) / __alignof__(shard_t) * \
+     __alignof__(shard_t))
+
+#define shard_hash(hash)                                                                     \
+    (&map_struct->shards[map_struct->shard_bits ? (hash) >> (32 - map_struct->shard_bits) : \
+                                                  0])
 
-enum next { elem_empty = -2, elem_last = -1 };
+static array_hashmap_time hashmap_time(void)
+{
+    return time(NULL);
+}
 
-#define index_add(data) (map_struct->add_hash(data) % map_struct->map_size)
-#define index_find(data) (map_struct->find_hash(data) % map_struct->map_size)
-#define index_del(data) (map_struct->del_hash(data) % map_struct->map_size)
-#define elem_i(index) ((elem_t *)&map_struct->map[index * map_struct->elem_size])
+void hashmap_already_in(hashmap_t *map_struct, void *hashmap_elem_data, const void *add_elem_data,
+                        void *res_elem_data, on_already_in_t on_already_in,
+                        array_hashmap_time expire)
+{
+    array_hashmap_bool is_save_new = 0;
+    array_hashmap_str_t str;
 
-array_hashmap_t array_hashmap_init(int32_t map_size, double max_load, int32_t type_size)
+    if (on_already_in) {
+        if (on_already_in == array_hashmap_save_new_func) {
+            is_save_new = 1;
+        } else {
+            is_save_new = on_already_in(add_elem_data, hashmap_elem_data);
+        }
+    }
+    if (is_save_new) {
+        /* The key is the same, keep the copy in the arena */
+        if (is_str_key()) {
+            memcpy(&str, hashmap_elem_data, sizeof(str));
+        }
+        memcpy(hashmap_elem_data, add_elem_data, map_struct->data_size);
+        if (is_str_key()) {
+            memcpy(hashmap_elem_data, &str, sizeof(str));
+        }
+        if (is_ttl()) {
+            data_expire(hashmap_elem_data) = expire;
+        }
+    }
+    if (res_elem_data) {
+        memcpy(res_elem_data, hashmap_elem_data, map_struct->data_size);
+    }
+}
+
+static void *hashmap_malloc(size_t size, void *arg)
+{
+    (void)arg;
+
+    return malloc(size);
+}
+
+static void hashmap_free(void *map, size_t size, void *arg)
+{
+    (void)size;
+    (void)arg;
+
+    free(map);
+}
+
+static size_t hashmap_mmap_size(hashmap_t *map_struct, size_t size)
+{
+    if (map_struct->flags & array_hashmap_opt_huge_pages) {
+        return (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    }
+
+    return page_align(size);
+}
+
+static void *hashmap_mmap(size_t size, void *arg)
 {
+    hashmap_t *map_struct = arg;
+    int32_t mmap_flags = MAP_PRIVATE | MAP_ANONYMOUS;
     char *map = NULL;
-    int32_t i = 0;
+    size_t offset = 0;
+    size_t i = 0;
 
-    hashmap_t *map_struct = NULL;
+    if (map_struct->flags & array_hashmap_opt_populate) {
+        mmap_flags |= MAP_POPULATE;
+    }
 
-    if (map_size <= 0) {
-        return NULL;
+    size = hashmap_mmap_size(map_struct, size);
+    if (!(map_struct->flags & array_hashmap_opt_huge_pages)) {
+        map = mmap(NULL, size, PROT_READ | PROT_WRITE, mmap_flags, -1, 0);
+        return map == MAP_FAILED ? NULL : map;
     }
 
-    if (type_size <= 0) {
-        return NULL;
+    map = mmap(NULL, size, PROT_READ | PROT_WRITE, mmap_flags | MAP_HUGETLB, -1, 0);
+    if (map != MAP_FAILED) {
+        return map;
     }
 
-    if (max_load <= 0) {
+    map = mmap(NULL, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+               -1, 0);
+    if (map == MAP_FAILED) {
         return NULL;
     }
 
-    if (max_load > 1.0) {
-        return NULL;
+    offset = (HUGE_PAGE_SIZE - (uintptr_t)map % HUGE_PAGE_SIZE) % HUGE_PAGE_SIZE;
+    if (offset) {
+        munmap(map, offset);
     }
+    munmap(map + offset + size, HUGE_PAGE_SIZE - offset);
+    map += offset;
 
-    map_struct = malloc(sizeof(hashmap_t));
-    if (!map_struct) {
-        return NULL;
+    madvise(map, size, MADV_HUGEPAGE);
+    if (map_struct->flags & array_hashmap_opt_populate) {
+        for (i = 0; i < size; i += PAGE_ALIGN) {
+            map[i] = 0;
+        }
     }
 
-    map_struct->map_size = map_size;
-    map_struct->max_size = map_size * max_load;
-    map_struct->data_size = type_size;
-    map_struct->elem_size = type_size + sizeof(elem_t) - sizeof(char);
-    map_struct->add_hash = NULL;
-    map_struct->add_cmp = NULL;
-    map_struct->find_hash = NULL;
-    map_struct->find_cmp = NULL;
-    map_struct->del_hash = NULL;
-    map_struct->del_cmp = NULL;
-    map_struct->now_in_map = 0;
+    return map;
+}
+
+static void hashmap_munmap(void *map, size_t size, void *arg)
+{
+    munmap(map, hashmap_mmap_size(arg, size));
+}
 
-    map = malloc(map_struct->map_size * map_struct->elem_size);
+static void table_free(hashmap_t *map_struct, char *map, int32_t map_size)
+{
     if (!map) {
-        free(map_struct);
-        return NULL;
+        return;
+    }
+
+    if (map >= map_struct->mapped && map < map_struct->mapped + map_struct->mapped_size) {
+        return;
+    }
+
+    map_struct->free_func(map, map_struct->engine->table_bytes(map_struct, map_size),
+                          map_struct->alloc_arg);
+}
+
+static void resize_finish(hashmap_t *map_struct, shard_t *shard)
+{
+    if (!(map_struct->flags & array_hashmap_opt_optimistic_read)) {
+        table_free(map_struct, shard->old_table.map, shard->old_table.map_size);
+    }
+    shard->old_table.map = NULL;
+    shard->old_table.ctrl = NULL;
+    shard->old_table.map_size = 0;
+    shard->old_table.max_size = 0;
+    shard->old_table.now_in_map = 0;
+    shard->old_table.deleted = 0;
+    shard->migrate_index = 0;
+    shard->migrate_blocked = 0;
+}
+
+static void migrate_step(hashmap_t *map_struct, shard_t *shard, int32_t step)
+{
+    /* The element the migration stopped at is not tried again before a delete */
+    if (shard->migrate_blocked) {
+        return;
+    }
+
+    while (is_migrating(shard) && step-- > 0) {
+        if (!map_struct->engine->migrate(map_struct, shard, shard->migrate_index)) {
+            shard->migrate_blocked = 1;
+            return;
+        }
+        shard->migrate_index++;
+
+        if (shard->migrate_index == shard->old_table.map_size ||
+            shard->old_table.now_in_map == 0) {
+            resize_finish(map_struct, shard);
+        }
+    }
+}
+
+static void migrate_unblock(shard_t *shard, int32_t now_in_map)
+{
+    if (all_in_map(shard) < now_in_map) {
+        shard->migrate_blocked = 0;
+    }
+}
+
+static void migrate_key(hashmap_t *map_struct, shard_t *shard, array_hashmap_hash hash,
+                        const void *elem_data, cmp_t cmp, int32_t cmp_stat)
+{
+    if (!shard->migrate_blocked) {
+        map_struct->engine->migrate_key(map_struct, shard, hash, elem_data, cmp, cmp_stat);
+    }
+    migrate_step(map_struct, shard, map_struct->migrate_step);
+}
+
+static array_hashmap_bool resize_start(hashmap_t *map_struct, shard_t *shard, int32_t map_size)
+{
+    table_t table;
+    retired_t *retired = NULL;
+
+    if (!map_struct->engine->table_init(map_struct, &table, map_size, NULL)) {
+        return 0;
+    }
+
+    if (map_struct->flags & array_hashmap_opt_optimistic_read) {
+        retired = malloc(sizeof(retired_t));
+        if (!retired) {
+            table_free(map_struct, table.map, table.map_size);
+            return 0;
+        }
+
+        retired->map = shard->table.map;
+        retired->map_size = shard->table.map_size;
+        retired->next = shard->retired;
+        shard->retired = retired;
+    }
+
+    shard->old_table = shard->table;
+    shard->table = table;
+    shard->migrate_index = 0;
+    shard->migrate_blocked = 0;
+
+    if (shard->old_table.now_in_map == 0) {
+        resize_finish(map_struct, shard);
+    }
+
+    return 1;
+}
+
+static array_hashmap_bool resize_grow(hashmap_t *map_struct, shard_t *shard)
+{
+    if (!(map_struct->flags & array_hashmap_opt_grow)) {
+        return 0;
+    }
+
+    if (shard->table.map_size > INT32_MAX / 2) {
+        return 0;
+    }
+
+    if (is_migrating(shard)) {
+        migrate_step(map_struct, shard, shard->old_table.map_size);
+    }
+
+    /* The cuckoo engine leaves the elements its new array can not take yet */
+    if (is_migrating(shard)) {
+        return 0;
+    }
+
+    /* Below half of max_size only colliding keys fill a cuckoo array, a bigger one is no help */
+    if (shard->table.now_in_map < shard->table.max_size / 2) {
+        return 0;
+    }
+
+    return resize_start(map_struct, shard, shard->table.map_size * 2);
+}
+
+static void resize_shrink(hashmap_t *map_struct, shard_t *shard)
+{
+    if (!(map_struct->flags & array_hashmap_opt_shrink)) {
+        return;
+    }
+
+    if (is_migrating(shard)) {
+        return;
+    }
+
+    if (shard->table.map_size / 2 < map_struct->min_map_size) {
+        return;
+    }
+
+    if (shard->table.now_in_map * 4 >= shard->table.max_size) {
+        return;
+    }
+
+    resize_start(map_struct, shard, shard->table.map_size / 2);
+}
+
+static void resize_purge(hashmap_t *map_struct, shard_t *shard)
+{
+    if (is_migrating(shard) || map_struct->is_shared) {
+        return;
+    }
+
+    if (shard->table.deleted <= shard->table.map_size / PURGE_DELETED_PART) {
+        return;
+    }
+
+    resize_start(map_struct, shard, shard->table.map_size);
+}
+
+/* Cleans the next part of the shard on every full add, so no add walks the whole shard */
+static array_hashmap_bool shard_expire(hashmap_t *map_struct, shard_t *shard)
+{
+    int32_t now_in_map = 0;
+    int32_t end = 0;
+
+    if (!is_ttl()) {
+        return 0;
+    }
+
+    now_in_map = all_in_map(shard);
+
+    if (is_migrating(shard)) {
+        migrate_step(map_struct, shard, EXPIRE_SCAN_SLOTS);
     }
-    map_struct->map = map;
 
+    if (shard->expire_index >= shard->table.map_size) {
+        shard->expire_index = 0;
+    }
+    end = shard->table.map_size - shard->expire_index > EXPIRE_SCAN_SLOTS
+              ? shard->expire_index + EXPIRE_SCAN_SLOTS
+              : shard->table.map_size;
+
+    map_struct->engine->del_by_func(map_struct, &shard->table, shard->expire_index, end, NULL);
+    shard->expire_index = end;
+    migrate_unblock(shard, now_in_map);
+
+    return all_in_map(shard) < now_in_map;
+}
+
+static void shard_write_lock(hashmap_t *map_struct, shard_t *shard)
+{
 #ifdef THREAD_SAFETY
-    if (pthread_rwlock_init(&map_struct->rwlock, NULL)) {
-        free(map);
-        free(map_struct);
-        return NULL;
+#ifdef LATENCY_STATS
+    uint64_t start = 0;
+#endif
+
+#ifdef LATENCY_STATS
+    if (!pthread_rwlock_trywrlock(&shard->rwlock)) {
+        latency_add(map_struct, array_hashmap_latency_write_lock, 0);
+    } else {
+        latency_start(start);
+        pthread_rwlock_wrlock(&shard->rwlock);
+        latency_end(array_hashmap_latency_write_lock, start);
     }
-    map_struct->is_thread_safety = 1;
 #else
-    map_struct->is_thread_safety = 0;
+    pthread_rwlock_wrlock(&shard->rwlock);
+#endif
+
+    __atomic_store_n(&shard->seq, shard->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    (void)map_struct;
+#else
+    (void)map_struct;
+    (void)shard;
+#endif
+}
+
+#ifdef THREAD_SAFETY
+static void shard_read_lock(hashmap_t *map_struct, shard_t *shard)
+{
+#ifdef LATENCY_STATS
+    uint64_t start = 0;
+#endif
+
+#ifdef LATENCY_STATS
+    if (!pthread_rwlock_tryrdlock(&shard->rwlock)) {
+        latency_add(map_struct, array_hashmap_latency_read_lock, 0);
+    } else {
+        latency_start(start);
+        pthread_rwlock_rdlock(&shard->rwlock);
+        latency_end(array_hashmap_latency_read_lock, start);
+    }
+#else
+    pthread_rwlock_rdlock(&shard->rwlock);
+#endif
+
+    (void)map_struct;
+}
+#endif
+
+static void shard_write_unlock(shard_t *shard)
+{
+#ifdef THREAD_SAFETY
+    __atomic_store_n(&shard->seq, shard->seq + 1, __ATOMIC_RELEASE);
+
+    pthread_rwlock_unlock(&shard->rwlock);
+#else
+    (void)shard;
+#endif
+}
+
+#ifdef THREAD_SAFETY
+static array_hashmap_ret_t shard_find_optimistic(hashmap_t *map_struct, shard_t *shard,
+                                                 array_hashmap_hash find_hash,
+                                                 const void *find_elem_data, void *res_elem_data)
+{
+    array_hashmap_ret_t find_res = 0;
+
+    uint32_t seq = 0;
+    table_t table;
+    table_t old_table;
+
+    seq = __atomic_load_n(&shard->seq, __ATOMIC_ACQUIRE);
+    if (seq & 1) {
+        return optimistic_retry;
+    }
+
+    table.map = read_once(shard->table.map);
+    table.ctrl = read_once(shard->table.ctrl);
+    table.map_size = read_once(shard->table.map_size);
+    old_table.map = read_once(shard->old_table.map);
+    old_table.ctrl = read_once(shard->old_table.ctrl);
+    old_table.map_size = read_once(shard->old_table.map_size);
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&shard->seq, __ATOMIC_RELAXED) != seq) {
+        return optimistic_retry;
+    }
+
+    find_res = map_struct->engine->find_once(map_struct, &table, find_hash, find_elem_data,
+                                             res_elem_data);
+    if (find_res == array_hashmap_elem_not_finded && old_table.map) {
+        find_res = map_struct->engine->find_once(map_struct, &old_table, find_hash,
+                                                 find_elem_data, res_elem_data);
+    }
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&shard->seq, __ATOMIC_RELAXED) != seq) {
+        return optimistic_retry;
+    }
+
+    return find_res;
+}
+#endif
+
+static void *shard_find_data(hashmap_t *map_struct, shard_t *shard, array_hashmap_hash find_hash,
+                             const void *find_elem_data)
+{
+    void *hashmap_elem_data = NULL;
+
+    hashmap_elem_data = map_struct->engine->find(map_struct, &shard->table, find_hash,
+                                                 find_elem_data);
+    if (!hashmap_elem_data && is_migrating(shard)) {
+        hashmap_elem_data = map_struct->engine->find(map_struct, &shard->old_table, find_hash,
+                                                     find_elem_data);
+    }
+
+    return hashmap_elem_data;
+}
+
+static array_hashmap_ret_t shard_find(hashmap_t *map_struct, shard_t *shard,
+                                      array_hashmap_hash find_hash, const void *find_elem_data,
+                                      void *res_elem_data)
+{
+    void *hashmap_elem_data = NULL;
+
+    hashmap_elem_data = shard_find_data(map_struct, shard, find_hash, find_elem_data);
+    if (!hashmap_elem_data) {
+        return array_hashmap_elem_not_finded;
+    }
+
+    if (res_elem_data) {
+        memcpy(res_elem_data, hashmap_elem_data, map_struct->data_size);
+    }
+
+    return array_hashmap_elem_finded;
+}
+
+#ifdef THREAD_SAFETY
+static int32_t shards_read_lock(hashmap_t *map_struct, shard_t **shards, int32_t count,
+                                shard_t **locked)
+{
+    int32_t locked_count = 0;
+    int32_t i = 0;
+    int32_t j = 0;
+
+    for (i = 0; i < count; i++) {
+        if (!shards[i]) {
+            continue;
+        }
+
+        j = locked_count;
+        while (j > 0 && locked[j - 1] > shards[i]) {
+            j--;
+        }
+
+        if (j > 0 && locked[j - 1] == shards[i]) {
+            continue;
+        }
+
+        memmove(&locked[j + 1], &locked[j], (locked_count - j) * sizeof(shard_t *));
+        locked[j] = shards[i];
+        locked_count++;
+    }
+
+    for (i = 0; i < locked_count; i++) {
+        shard_read_lock(map_struct, locked[i]);
+    }
+
+    return locked_count;
+}
+#endif
+
+static void shards_free(hashmap_t *map_struct, int32_t shard_count)
+{
+    int32_t i = 0;
+
+    for (i = 0; i < shard_count; i++) {
+        shard_t *shard = &map_struct->shards[i];
+
+        if (map_struct->flags & array_hashmap_opt_optimistic_read) {
+            while (shard->retired) {
+                retired_t *retired = shard->retired;
+
+                shard->retired = retired->next;
+                table_free(map_struct, retired->map, retired->map_size);
+                free(retired);
+            }
+        } else {
+            table_free(map_struct, shard->old_table.map, shard->old_table.map_size);
+        }
+        table_free(map_struct, shard->table.map, shard->table.map_size);
+        str_free(shard);
+#ifdef THREAD_SAFETY
+        pthread_rwlock_destroy(&shard->rwlock);
+#endif
+    }
+
+    free(map_struct->shards);
+}
+
+static void shard_reset(shard_t *shard)
+{
+    shard->old_table.map = NULL;
+    shard->old_table.ctrl = NULL;
+    shard->old_table.map_size = 0;
+    shard->old_table.max_size = 0;
+    shard->old_table.now_in_map = 0;
+    shard->old_table.deleted = 0;
+    shard->migrate_index = 0;
+    shard->migrate_blocked = 0;
+    shard->expire_index = 0;
+    shard->retired = NULL;
+    shard->arena = NULL;
+#ifdef THREAD_SAFETY
+    shard->seq = 0;
 #endif
+}
+
+static array_hashmap_bool shards_init(hashmap_t *map_struct, int32_t map_size,
+                                      const table_t *tables)
+{
+    int32_t i = 0;
+    void *shards = NULL;
+
+    if (posix_memalign(&shards, __alignof__(shard_t), map_struct->shard_count * sizeof(shard_t))) {
+        return 0;
+    }
+    map_struct->shards = shards;
+
+    for (i = 0; i < map_struct->shard_count; i++) {
+        shard_t *shard = &map_struct->shards[i];
+
+        shard_reset(shard);
+
+        if (tables) {
+            shard->table = tables[i];
+        } else if (!map_struct->engine->table_init(map_struct, &shard->table, map_size, NULL)) {
+            shards_free(map_struct, i);
+            return 0;
+        }
+
+#ifdef THREAD_SAFETY
+        if (pthread_rwlock_init(&shard->rwlock, NULL)) {
+            table_free(map_struct, shard->table.map, shard->table.map_size);
+            shards_free(map_struct, i);
+            return 0;
+        }
+#endif
+    }
+
+    return 1;
+}
+
+array_hashmap_t array_hashmap_init(int32_t map_size, double max_load, int32_t type_size)
+{
+    return array_hashmap_init_opts(map_size, max_load, type_size, NULL);
+}
+
+static hashmap_t *hashmap_new(int32_t map_size, double max_load, int32_t type_size,
+                              const array_hashmap_opts_t *opts)
+{
+    int32_t shard_count = 1;
+    int32_t shard_bits = 0;
+    const engine_t *engine = &chain_engine;
+
+    hashmap_t *map_struct = NULL;
+
+    if (map_size <= 0) {
+        return NULL;
+    }
+
+    if (type_size <= 0) {
+        return NULL;
+    }
+
+    if (max_load <= 0) {
+        return NULL;
+    }
+
+    if (max_load > 1.0) {
+        return NULL;
+    }
+
+    if (opts) {
+        if (opts->migrate_step < 0) {
+            return NULL;
+        }
+
+        if ((opts->flags & array_hashmap_opt_shrink) && !(opts->flags & array_hashmap_opt_grow)) {
+            return NULL;
+        }
+
+        if ((opts->flags & array_hashmap_opt_shrink) &&
+            (opts->flags & array_hashmap_opt_optimistic_read)) {
+            return NULL;
+        }
+
+        if ((opts->flags & array_hashmap_opt_str_key) &&
+            ((opts->flags & array_hashmap_opt_optimistic_read) ||
+             type_size < (int32_t)sizeof(array_hashmap_str_t))) {
+            return NULL;
+        }
+
+        if (opts->key_size < array_hashmap_key_cstr || opts->key_size > type_size ||
+            (opts->key_size == array_hashmap_key_cstr && type_size < (int32_t)sizeof(char *)) ||
+            (opts->key_size && (opts->flags & array_hashmap_opt_str_key))) {
+            return NULL;
+        }
+
+        if (opts->shard_count < 0 || opts->shard_count > array_hashmap_max_shards) {
+            return NULL;
+        }
+
+        if (opts->shard_count & (opts->shard_count - 1)) {
+            return NULL;
+        }
+
+        if (opts->engine == array_hashmap_engine_swiss ||
+            opts->engine == array_hashmap_engine_cuckoo) {
+            if (opts->flags & (array_hashmap_opt_optimistic_read | array_hashmap_opt_split_data)) {
+                return NULL;
+            }
+
+            engine = opts->engine == array_hashmap_engine_swiss ? &swiss_engine : &cuckoo_engine;
+        } else if (opts->engine != array_hashmap_engine_chain) {
+            return NULL;
+        }
+
+        if (opts->hash_func != array_hashmap_hash_wy &&
+            opts->hash_func != array_hashmap_hash_crc32c) {
+            return NULL;
+        }
+
+        if (!opts->alloc_func != !opts->free_func) {
+            return NULL;
+        }
+
+        if (opts->alloc_func &&
+            (opts->flags & (array_hashmap_opt_huge_pages | array_hashmap_opt_populate))) {
+            return NULL;
+        }
+
+        if (opts->shard_count) {
+            shard_count = opts->shard_count;
+        }
+    }
+
+    while ((1 << shard_bits) < shard_count) {
+        shard_bits++;
+    }
+
+    map_struct = malloc(sizeof(hashmap_t));
+    if (!map_struct) {
+        return NULL;
+    }
+
+    map_struct->shard_count = shard_count;
+    map_struct->shard_bits = shard_bits;
+    map_struct->max_load = max_load;
+    map_struct->min_map_size = (map_size + shard_count - 1) / shard_count;
+    map_struct->engine = engine;
+    map_struct->data_size = type_size;
+    map_struct->data_offset = engine->header_size;
+    if (opts && (opts->flags & array_hashmap_opt_store_hash)) {
+        map_struct->data_offset += sizeof(array_hashmap_hash);
+    }
+    if (opts && (opts->flags & array_hashmap_opt_ttl)) {
+        map_struct->data_offset += sizeof(array_hashmap_time);
+    }
+    map_struct->elem_size = map_struct->data_offset + type_size;
+    map_struct->data_stride = map_struct->elem_size;
+    if (opts && (opts->flags & array_hashmap_opt_split_data)) {
+        map_struct->elem_size = map_struct->data_offset;
+        map_struct->data_offset = 0;
+        if (opts->flags & array_hashmap_opt_ttl) {
+            map_struct->elem_size -= sizeof(array_hashmap_time);
+            map_struct->data_offset = sizeof(array_hashmap_time);
+        }
+        map_struct->data_stride = map_struct->data_offset + type_size;
+    }
+    map_struct->add_hash = NULL;
+    map_struct->add_cmp = NULL;
+    map_struct->find_hash = NULL;
+    map_struct->find_cmp = NULL;
+    map_struct->del_hash = NULL;
+    map_struct->del_cmp = NULL;
+    if (opts && (opts->flags & array_hashmap_opt_str_key)) {
+        map_struct->add_hash = str_hash;
+        map_struct->add_cmp = str_cmp;
+        map_struct->find_hash = str_hash;
+        map_struct->find_cmp = str_cmp;
+        map_struct->del_hash = str_hash;
+        map_struct->del_cmp = str_cmp;
+    }
+    map_struct->hash_func = opts ? opts->hash_func : array_hashmap_hash_wy;
+    map_struct->seed = opts && opts->seed ? opts->seed : hash_seed(map_struct);
+    map_struct->hash_bytes = hash_select(map_struct->hash_func);
+    map_struct->key_size = opts ? opts->key_size : 0;
+    map_struct->time_func = hashmap_time;
+    map_struct->alloc_func = hashmap_malloc;
+    map_struct->free_func = hashmap_free;
+    map_struct->alloc_arg = NULL;
+    memset(map_struct->stats, 0, sizeof(map_struct->stats));
+#ifdef LATENCY_STATS
+    latency_init(map_struct);
+#endif
+    map_struct->mapped = NULL;
+    map_struct->mapped_size = 0;
+    map_struct->is_shared = 0;
+
+    map_struct->flags = 0;
+    map_struct->migrate_step = MIGRATE_STEP_DEFAULT;
+    if (opts) {
+        map_struct->flags = opts->flags;
+#ifndef THREAD_SAFETY
+        map_struct->flags &= ~array_hashmap_opt_optimistic_read;
+#endif
+        if (opts->migrate_step) {
+            map_struct->migrate_step = opts->migrate_step;
+        }
+        if (opts->alloc_func) {
+            map_struct->alloc_func = opts->alloc_func;
+            map_struct->free_func = opts->free_func;
+            map_struct->alloc_arg = opts->alloc_arg;
+        } else if (opts->flags & (array_hashmap_opt_huge_pages | array_hashmap_opt_populate)) {
+            map_struct->alloc_func = hashmap_mmap;
+            map_struct->free_func = hashmap_munmap;
+            map_struct->alloc_arg = map_struct;
+        }
+    }
+
+#ifdef THREAD_SAFETY
+    map_struct->is_thread_safety = 1;
+#else
+    map_struct->is_thread_safety = 0;
+#endif
+
+    return map_struct;
+}
+
+array_hashmap_t array_hashmap_init_opts(int32_t map_size, double max_load, int32_t type_size,
+                                        const array_hashmap_opts_t *opts)
+{
+    hashmap_t *map_struct = NULL;
+
+    map_struct = hashmap_new(map_size, max_load, type_size, opts);
+    if (!map_struct) {
+        return NULL;
+    }
+
+    if (!shards_init(map_struct, map_struct->min_map_size, NULL)) {
+        free(map_struct);
+        return NULL;
+    }
+
+    return (array_hashmap_t)map_struct;
+}
+
+void array_hashmap_set_func(array_hashmap_t map_struct_c, add_hash_t add_hash, add_cmp_t add_cmp,
+                            find_hash_t find_hash, find_cmp_t find_cmp, del_hash_t del_hash,
+                            del_cmp_t del_cmp)
+{
+#ifdef THREAD_SAFETY
+    int32_t i = 0;
+#endif
+
+    hashmap_t *map_struct = NULL;
+    map_struct = (hashmap_t *)map_struct_c;
+    if (!map_struct) {
+        return;
+    }
+
+#ifdef THREAD_SAFETY
+    for (i = 0; i < map_struct->shard_count; i++) {
+        pthread_rwlock_wrlock(&map_struct->shards[i].rwlock);
+    }
+#endif
+
+    map_struct->add_hash = add_hash;
+    map_struct->add_cmp = add_cmp;
+
+    map_struct->find_hash = find_hash;
+    map_struct->find_cmp = find_cmp;
+
+    map_struct->del_hash = del_hash;
+    map_struct->del_cmp = del_cmp;
+
+#ifdef THREAD_SAFETY
+    for (i = 0; i < map_struct->shard_count; i++) {
+        pthread_rwlock_unlock(&map_struct->shards[i].rwlock);
+    }
+#endif
+}
+
+void array_hashmap_set_time_func(array_hashmap_t map_struct_c, time_func_t time_func)
+{
+#ifdef THREAD_SAFETY
+    int32_t i = 0;
+#endif
+
+    hashmap_t *map_struct = NULL;
+    map_struct = (hashmap_t *)map_struct_c;
+    if (!map_struct || !time_func) {
+        return;
+    }
+
+#ifdef THREAD_SAFETY
+    for (i = 0; i < map_struct->shard_count; i++) {
+        pthread_rwlock_wrlock(&map_struct->shards[i].rwlock);
+    }
+#endif
+
+    map_struct->time_func = time_func;
+
+#ifdef THREAD_SAFETY
+    for (i = 0; i < map_struct->shard_count; i++) {
+        pthread_rwlock_unlock(&map_struct->shards[i].rwlock);
+    }
+#endif
+}
+
+int32_t array_hashmap_now_in_map(array_hashmap_t map_struct_c)
+{
+    int32_t now_in_map = 0;
+    int32_t i = 0;
+
+    hashmap_t *map_struct = NULL;
+    map_struct = (hashmap_t *)map_struct_c;
+    if (!map_struct) {
+        return array_hashmap_empty_args;
+    }
+
+    for (i = 0; i < map_struct->shard_count; i++) {
+        now_in_map += all_in_map(&map_struct->shards[i]);
+    }
+
+    return now_in_map;
+}
+
+int32_t array_hashmap_map_size(array_hashmap_t map_struct_c)
+{
+    int32_t map_size = 0;
+    int32_t i = 0;
+
+    hashmap_t *map_struct = NULL;
+    map_struct = (hashmap_t *)map_struct_c;
+    if (!map_struct) {
+        return array_hashmap_empty_args;
+    }
+
+    for (i = 0; i < map_struct->shard_count; i++) {
+        map_size += map_struct->shards[i].table.map_size;
+    }
+
+    return map_size;
+}
+
+array_hashmap_bool array_hashmap_is_thread_safety(array_hashmap_t map_struct_c)
+{
+    hashmap_t *map_struct = NULL;
+    map_struct = (hashmap_t *)map_struct_c;
+    if (!map_struct) {
+        return array_hashmap_empty_args;
+    }
+
+    return map_struct->is_thread_safety;
+}
+
+array_hashmap_bool array_hashmap_get_stats(array_hashmap_t map_struct_c,
+                                           array_hashmap_stats_t *stats)
+{
+    shard_t *shard = NULL;
+    int32_t i = 0;
+
+    hashmap_t *map_struct = NULL;
+    map_struct = (hashmap_t *)map_struct_c;
+    if (!map_struct || !stats) {
+        return array_hashmap_empty_args;
+    }
+
+    memset(stats, 0, sizeof(*stats));
+
+    for (i = 0; i < map_struct->shard_count; i++) {
+        shard = &map_struct->shards[i];
+
+#ifdef THREAD_SAFETY
+        pthread_rwlock_rdlock(&shard->rwlock);
+#endif
+
+        stats->map_size += shard->table.map_size;
+        stats->now_in_map += all_in_map(shard);
+        map_struct->engine->stats(map_struct, &shard->table, stats);
+        if (is_migrating(shard)) {
+            map_struct->engine->stats(map_struct, &shard->old_table, stats);
+        }
+
+#ifdef THREAD_SAFETY
+        pthread_rwlock_unlock(&shard->rwlock);
+#endif
+    }
+
+    if (stats->chain_count) {
+        stats->chain_avg /= stats->chain_count;
+    }
+
+    stats->add_cmp_calls = __atomic_load_n(&map_struct->stats[stat_add_cmp], __ATOMIC_RELAXED);
+    stats->find_cmp_calls = __atomic_load_n(&map_struct->stats[stat_find_cmp], __ATOMIC_RELAXED);
+    stats->del_cmp_calls = __atomic_load_n(&map_struct->stats[stat_del_cmp], __ATOMIC_RELAXED);
+    stats->displacements = __atomic_load_n(&map_struct->stats[stat_displace], __ATOMIC_RELAXED);
+    stats->free_searches = __atomic_load_n(&map_struct->stats[stat_free_search], __ATOMIC_RELAXED);
+    if (stats->free_searches) {
+        stats->free_search_avg =
+            (double)__atomic_load_n(&map_struct->stats[stat_free_distance], __ATOMIC_RELAXED) /
+            stats->free_searches;
+    }
+
+    return 1;
+}
+
+array_hashmap_ret_t array_hashmap_add_elem(array_hashmap_t map_struct_c, const void *add_elem_data,
+                                           void *res_elem_data, on_already_in_t on_already_in)
+{
+    return array_hashmap_add_elem_expire(map_struct_c, add_elem_data, res_elem_data, on_already_in,
+                                         array_hashmap_no_expire);
+}
+
+static array_hashmap_ret_t shard_add(hashmap_t *map_struct, shard_t *shard,
+                                     array_hashmap_hash add_hash, const void *add_elem_data,
+                                     void *res_elem_data, on_already_in_t on_already_in,
+                                     array_hashmap_time expire, void **hashmap_elem_data)
+{
+    array_hashmap_ret_t add_res = 0;
+
+    /* Room for a long key is made before the add, compaction moves no elements after it */
+    if (is_str_key() && !str_reserve(map_struct, shard, add_elem_data)) {
+        return array_hashmap_full;
+    }
+
+    if (is_migrating(shard)) {
+        migrate_key(map_struct, shard, add_hash, add_elem_data, map_struct->add_cmp, stat_add_cmp);
+    }
+
+    add_res = map_struct->engine->add(map_struct, shard, add_hash, add_elem_data, res_elem_data,
+                                      on_already_in, expire, hashmap_elem_data);
+    if (add_res == array_hashmap_full && shard_expire(map_struct, shard)) {
+        add_res = map_struct->engine->add(map_struct, shard, add_hash, add_elem_data,
+                                          res_elem_data, on_already_in, expire,
+                                          hashmap_elem_data);
+    }
+    while (add_res == array_hashmap_full && resize_grow(map_struct, shard)) {
+        add_res = map_struct->engine->add(map_struct, shard, add_hash, add_elem_data,
+                                          res_elem_data, on_already_in, expire,
+                                          hashmap_elem_data);
+    }
+
+    if (is_str_key() && add_res == array_hashmap_elem_added) {
+        str_store(shard, *hashmap_elem_data);
+    }
+
+    return add_res;
+}
+
+array_hashmap_ret_t array_hashmap_add_elem_expire(array_hashmap_t map_struct_c,
+                                                  const void *add_elem_data, void *res_elem_data,
+                                                  on_already_in_t on_already_in,
+                                                  array_hashmap_time expire)
+{
+    array_hashmap_ret_t add_res = 0;
+#ifdef LATENCY_STATS
+    uint64_t start = 0;
+#endif
+
+    array_hashmap_hash add_hash = 0;
+    shard_t *shard = NULL;
+    void *hashmap_elem_data = NULL;
+
+    hashmap_t *map_struct = NULL;
+    map_struct = (hashmap_t *)map_struct_c;
+    if (!map_struct || !add_elem_data) {
+        return array_hashmap_empty_args;
+    }
+
+    if (!is_ttl() && expire != array_hashmap_no_expire) {
+        return array_hashmap_empty_args;
+    }
+
+    if (!is_func_set(add_hash, add_cmp)) {
+        return array_hashmap_empty_funcs;
+    }
+
+    latency_start(start);
+
+    add_hash = func_hash(add_hash, add_elem_data);
+    shard = shard_hash(add_hash);
+
+    shard_write_lock(map_struct, shard);
+
+    add_res = shard_add(map_struct, shard, add_hash, add_elem_data, res_elem_data, on_already_in,
+                        expire, &hashmap_elem_data);
+    if (add_res == array_hashmap_elem_added) {
+        resize_purge(map_struct, shard);
+    }
+
+    shard_write_unlock(shard);
+
+    latency_end(array_hashmap_latency_add, start);
+    return add_res;
+}
+
+static array_hashmap_ret_t hashmap_upsert(array_hashmap_t map_struct_c, const void *add_elem_data,
+                                          upsert_func_t init_func, upsert_func_t update_func,
+                                          void *arg, array_hashmap_time expire,
+                                          array_hashmap_bool is_expire_set)
+{
+    array_hashmap_ret_t add_res = 0;
+#ifdef LATENCY_STATS
+    uint64_t start = 0;
+#endif
+
+    array_hashmap_hash add_hash = 0;
+    shard_t *shard = NULL;
+    void *hashmap_elem_data = NULL;
+
+    hashmap_t *map_struct = NULL;
+    map_struct = (hashmap_t *)map_struct_c;
+    if (!map_struct || !add_elem_data) {
+        return array_hashmap_empty_args;
+    }
+
+    if (!is_ttl() && expire != array_hashmap_no_expire) {
+        return array_hashmap_empty_args;
+    }
+
+    if (!is_func_set(add_hash, add_cmp)) {
+        return array_hashmap_empty_funcs;
+    }
+
+    latency_start(start);
+
+    add_hash = func_hash(add_hash, add_elem_data);
+    shard = shard_hash(add_hash);
+
+    shard_write_lock(map_struct, shard);
+
+    /* The callbacks run before resize_purge, which can move the element */
+    add_res = shard_add(map_struct, shard, add_hash, add_elem_data, NULL, NULL, expire,
+                        &hashmap_elem_data);
+    if (add_res == array_hashmap_elem_added) {
+        if (init_func) {
+            init_func(hashmap_elem_data, add_elem_data, arg);
+        }
+
+        resize_purge(map_struct, shard);
+    } else if (add_res == array_hashmap_elem_already_in) {
+        if (update_func) {
+            update_func(hashmap_elem_data, add_elem_data, arg);
+        }
+        if (is_ttl() && is_expire_set) {
+            data_expire(hashmap_elem_data) = expire;
+        }
+    }
+
+    shard_write_unlock(shard);
+
+    latency_end(array_hashmap_latency_add, start);
+    return add_res;
+}
+
+array_hashmap_ret_t array_hashmap_upsert(array_hashmap_t map_struct_c, const void *add_elem_data,
+                                         upsert_func_t init_func, upsert_func_t update_func,
+                                         void *arg)
+{
+    return hashmap_upsert(map_struct_c, add_elem_data, init_func, update_func, arg,
+                          array_hashmap_no_expire, 0);
+}
+
+array_hashmap_ret_t array_hashmap_upsert_expire(array_hashmap_t map_struct_c,
+                                                const void *add_elem_data, upsert_func_t init_func,
+                                                upsert_func_t update_func, void *arg,
+                                                array_hashmap_time expire)
+{
+    return hashmap_upsert(map_struct_c, add_elem_data, init_func, update_func, arg, expire, 1);
+}
+
+array_hashmap_ret_t array_hashmap_find_elem(array_hashmap_t map_struct_c,
+                                            const void *find_elem_data, void *res_elem_data)
+{
+    array_hashmap_ret_t find_res = 0;
+#ifdef THREAD_SAFETY
+    int32_t i = 0;
+#endif
+#ifdef LATENCY_STATS
+    uint64_t start = 0;
+#endif
+
+    array_hashmap_hash find_hash = 0;
+    shard_t *shard = NULL;
+
+    hashmap_t *map_struct = NULL;
+    map_struct = (hashmap_t *)map_struct_c;
+    if (!map_struct || !find_elem_data) {
+        return array_hashmap_empty_args;
+    }
+
+    if (!is_func_set(find_hash, find_cmp)) {
+        return array_hashmap_empty_funcs;
+    }
+
+    latency_start(start);
+
+    find_hash = func_hash(find_hash, find_elem_data);
+    shard = shard_hash(find_hash);
+
+#ifdef THREAD_SAFETY
+    if (map_struct->flags & array_hashmap_opt_optimistic_read) {
+        for (i = 0; i < OPTIMISTIC_READ_TRIES; i++) {
+            find_res = shard_find_optimistic(map_struct, shard, find_hash, find_elem_data,
+                                             res_elem_data);
+            if (find_res != optimistic_retry) {
+                latency_end(array_hashmap_latency_find, start);
+                return find_res;
+            }
+        }
+    }
+
+    shard_read_lock(map_struct, shard);
+#endif
+
+    find_res = shard_find(map_struct, shard, find_hash, find_elem_data, res_elem_data);
+
+#ifdef THREAD_SAFETY
+    pthread_rwlock_unlock(&shard->rwlock);
+#endif
+
+    latency_end(array_hashmap_latency_find, start);
+    return find_res;
+}
+
+int32_t array_hashmap_find_batch(array_hashmap_t map_struct_c, const void *const *find_elems_data,
+                                 int32_t count, void *res_elems_data,
+                                 array_hashmap_ret_t *find_res)
+{
+    int32_t finded_count = 0;
+    int32_t batch = 0;
+    int32_t batch_size = 0;
+    int32_t i = 0;
+
+    array_hashmap_hash find_hash[FIND_BATCH];
+    shard_t *shard[FIND_BATCH];
+    char *res_elem_data = NULL;
+#ifdef THREAD_SAFETY
+    shard_t *locked[FIND_BATCH];
+    int32_t locked_count = 0;
+#endif
+
+    hashmap_t *map_struct = NULL;
+    map_struct = (hashmap_t *)map_struct_c;
+    if (!map_struct || !find_elems_data || count < 0 || !find_res) {
+        return array_hashmap_empty_args;
+    }
+
+    if (!is_func_set(find_hash, find_cmp)) {
+        return array_hashmap_empty_funcs;
+    }
+
+    for (batch = 0; batch < count; batch += FIND_BATCH) {
+        batch_size = count - batch < FIND_BATCH ? count - batch : FIND_BATCH;
+
+        for (i = 0; i < batch_size; i++) {
+            shard[i] = NULL;
+            if (find_elems_data[batch + i]) {
+                find_hash[i] = func_hash(find_hash, find_elems_data[batch + i]);
+                shard[i] = shard_hash(find_hash[i]);
+            }
+        }
+
+#ifdef THREAD_SAFETY
+        locked_count = shards_read_lock(map_struct, shard, batch_size, locked);
+#endif
+
+        for (i = 0; i < batch_size; i++) {
+            if (shard[i]) {
+                map_struct->engine->prefetch(map_struct, &shard[i]->table, find_hash[i], 0);
+            }
+        }
+
+        for (i = 0; i < batch_size; i++) {
+            if (shard[i]) {
+                map_struct->engine->prefetch(map_struct, &shard[i]->table, find_hash[i], 1);
+            }
+        }
+
+        for (i = 0; i < batch_size; i++) {
+            if (!shard[i]) {
+                find_res[batch + i] = array_hashmap_empty_args;
+                continue;
+            }
+
+            res_elem_data = NULL;
+            if (res_elems_data) {
+                res_elem_data =
+                    (char *)res_elems_data + (size_t)(batch + i) * map_struct->data_size;
+            }
+
+            find_res[batch + i] = shard_find(map_struct, shard[i], find_hash[i],
+                                             find_elems_data[batch + i], res_elem_data);
+            if (find_res[batch + i] == array_hashmap_elem_finded) {
+                finded_count++;
+            }
+        }
+
+#ifdef THREAD_SAFETY
+        for (i = 0; i < locked_count; i++) {
+            pthread_rwlock_unlock(&locked[i]->rwlock);
+        }
+#endif
+    }
+
+    return finded_count;
+}
+
+array_hashmap_ret_t array_hashmap_find_lease(array_hashmap_t map_struct_c,
+                                             const void *find_elem_data,
+                                             array_hashmap_lease_t *lease)
+{
+#ifdef LATENCY_STATS
+    uint64_t start = 0;
+#endif
+
+    array_hashmap_hash find_hash = 0;
+    shard_t *shard = NULL;
+
+    hashmap_t *map_struct = NULL;
+    map_struct = (hashmap_t *)map_struct_c;
+    if (!map_struct || !find_elem_data || !lease) {
+        return array_hashmap_empty_args;
+    }
+
+    lease->map_struct = map_struct_c;
+    lease->elem_data = NULL;
+    lease->shard = 0;
+
+    if (!is_func_set(find_hash, find_cmp)) {
+        return array_hashmap_empty_funcs;
+    }
+
+    latency_start(start);
+
+    find_hash = func_hash(find_hash, find_elem_data);
+    shard = shard_hash(find_hash);
+
+    /* The read lock is kept until the release, so writers can't move or free the element */
+#ifdef THREAD_SAFETY
+    shard_read_lock(map_struct, shard);
+#endif
+
+    lease->elem_data = shard_find_data(map_struct, shard, find_hash, find_elem_data);
+    lease->shard = (int32_t)(shard - map_struct->shards);
+
+#ifdef THREAD_SAFETY
+    if (!lease->elem_data) {
+        pthread_rwlock_unlock(&shard->rwlock);
+    }
+#endif
+
+    latency_end(array_hashmap_latency_find, start);
+    return lease->elem_data ? array_hashmap_elem_finded : array_hashmap_elem_not_finded;
+}
+
+void array_hashmap_lease_release(array_hashmap_lease_t *lease)
+{
+#ifdef THREAD_SAFETY
+    hashmap_t *map_struct = NULL;
+#endif
+
+    if (!lease || !lease->elem_data) {
+        return;
+    }
+
+#ifdef THREAD_SAFETY
+    map_struct = (hashmap_t *)lease->map_struct;
+    pthread_rwlock_unlock(&map_struct->shards[lease->shard].rwlock);
+#endif
+
+    lease->elem_data = NULL;
+}
+
+array_hashmap_ret_t array_hashmap_del_elem(array_hashmap_t map_struct_c, const void *del_elem_data,
+                                           void *res_elem_data)
+{
+    array_hashmap_ret_t del_res = 0;
+#ifdef LATENCY_STATS
+    uint64_t start = 0;
+#endif
+
+    array_hashmap_hash del_hash = 0;
+    shard_t *shard = NULL;
+
+    hashmap_t *map_struct = NULL;
+    map_struct = (hashmap_t *)map_struct_c;
+    if (!map_struct || !del_elem_data) {
+        return array_hashmap_empty_args;
+    }
+
+    if (!is_func_set(del_hash, del_cmp)) {
+        return array_hashmap_empty_funcs;
+    }
+
+    latency_start(start);
+
+    del_hash = func_hash(del_hash, del_elem_data);
+    shard = shard_hash(del_hash);
+
+    shard_write_lock(map_struct, shard);
+
+    if (is_migrating(shard)) {
+        migrate_key(map_struct, shard, del_hash, del_elem_data, map_struct->del_cmp, stat_del_cmp);
+    }
+
+    del_res = map_struct->engine->del(map_struct, &shard->table, del_hash, del_elem_data,
+                                      res_elem_data);
+    if (del_res != array_hashmap_elem_deled && is_migrating(shard)) {
+        del_res = map_struct->engine->del(map_struct, &shard->old_table, del_hash, del_elem_data,
+                                          res_elem_data);
+    }
+    if (del_res == array_hashmap_elem_deled) {
+        shard->migrate_blocked = 0;
+        resize_shrink(map_struct, shard);
+        resize_purge(map_struct, shard);
+    }
+
+    shard_write_unlock(shard);
+
+    latency_end(array_hashmap_latency_del, start);
+    return del_res;
+}
+
+#ifdef THREAD_SAFETY
+static void *sweep_mark_thread_func(void *arg)
+{
+    sweep_part_t *part = arg;
+    hashmap_t *map_struct = part->map_struct;
+
+    map_struct->engine->del_mark(map_struct, &part->table, part->from, part->to, part->del_func,
+                                 part->marks);
+
+    return NULL;
+}
+
+static void *sweep_del_thread_func(void *arg)
+{
+    sweep_part_t *part = arg;
+    hashmap_t *map_struct = part->map_struct;
+
+    part->del_count = map_struct->engine->del_marked(map_struct, &part->table, part->from,
+                                                     part->to, part->marks);
+
+    return NULL;
+}
+
+static void sweep_run(sweep_part_t *parts, int32_t thread_count, void *(*thread_func)(void *))
+{
+    int32_t i = 0;
+
+    for (i = 1; i < thread_count; i++) {
+        parts[i].is_thread = !pthread_create(&parts[i].thread, NULL, thread_func, &parts[i]);
+        if (!parts[i].is_thread) {
+            thread_func(&parts[i]);
+        }
+    }
+
+    thread_func(&parts[0]);
+
+    for (i = 1; i < thread_count; i++) {
+        if (parts[i].is_thread) {
+            pthread_join(parts[i].thread, NULL);
+        }
+    }
+}
+
+static int32_t shard_del_by_func_parallel(hashmap_t *map_struct, shard_t *shard,
+                                          del_func_t del_func, sweep_part_t *parts,
+                                          int32_t thread_count)
+{
+    int32_t del_count = 0;
+    int32_t i = 0;
+
+    table_t *table = NULL;
+    uint8_t *marks = NULL;
+
+    table = &shard->table;
+
+    marks = malloc(table->map_size);
+    if (!marks) {
+        return map_struct->engine->del_by_func(map_struct, table, 0, table->map_size, del_func);
+    }
+
+    for (i = 0; i < thread_count; i++) {
+        parts[i].map_struct = map_struct;
+        parts[i].table = *table;
+        parts[i].table.now_in_map = 0;
+        parts[i].table.deleted = 0;
+        parts[i].del_func = del_func;
+        parts[i].marks = marks;
+        parts[i].from = (int64_t)table->map_size * i / thread_count;
+        parts[i].to = (int64_t)table->map_size * (i + 1) / thread_count;
+        parts[i].del_count = 0;
+    }
+
+    sweep_run(parts, thread_count, sweep_mark_thread_func);
+    sweep_run(parts, thread_count, sweep_del_thread_func);
+
+    for (i = 0; i < thread_count; i++) {
+        del_count += parts[i].del_count;
+        table->now_in_map += parts[i].table.now_in_map;
+        table->deleted += parts[i].table.deleted;
+    }
+
+    free(marks);
+
+    return del_count;
+}
+#endif
+
+array_hashmap_deled_count array_hashmap_del_elem_by_func(array_hashmap_t map_struct_c,
+                                                         del_func_t del_func)
+{
+    return array_hashmap_del_elem_by_func_parallel(map_struct_c, del_func, 1);
+}
+
+array_hashmap_deled_count array_hashmap_del_elem_by_func_parallel(array_hashmap_t map_struct_c,
+                                                                  del_func_t del_func,
+                                                                  int32_t thread_count)
+{
+    int32_t del_count = 0;
+    int32_t now_in_map = 0;
+    int32_t i = 0;
+
+    shard_t *shard = NULL;
+#ifdef THREAD_SAFETY
+    sweep_part_t *parts = NULL;
+#endif
+
+    hashmap_t *map_struct = NULL;
+    map_struct = (hashmap_t *)map_struct_c;
+    if (!map_struct || (!del_func && !is_ttl()) || thread_count <= 0) {
+        return array_hashmap_empty_args;
+    }
+
+#ifdef THREAD_SAFETY
+    if (thread_count > 1) {
+        parts = malloc(thread_count * sizeof(sweep_part_t));
+    }
+#endif
+
+    for (i = 0; i < map_struct->shard_count; i++) {
+        shard = &map_struct->shards[i];
+
+        shard_write_lock(map_struct, shard);
+
+        now_in_map = all_in_map(shard);
+
+        if (is_migrating(shard)) {
+            migrate_step(map_struct, shard, shard->old_table.map_size);
+        }
+
+        /* Elements of a stopped migration are swept where they are */
+        if (is_migrating(shard)) {
+            del_count += map_struct->engine->del_by_func(map_struct, &shard->old_table, 0,
+                                                         shard->old_table.map_size, del_func);
+        }
+
+#ifdef THREAD_SAFETY
+        if (parts) {
+            del_count +=
+                shard_del_by_func_parallel(map_struct, shard, del_func, parts, thread_count);
+        } else {
+            del_count += map_struct->engine->del_by_func(map_struct, &shard->table, 0,
+                                                         shard->table.map_size, del_func);
+        }
+#else
+        del_count += map_struct->engine->del_by_func(map_struct, &shard->table, 0,
+                                                     shard->table.map_size, del_func);
+#endif
+
+        migrate_unblock(shard, now_in_map);
+
+        if (is_str_key()) {
+            str_compact(map_struct, shard);
+        }
+
+        resize_shrink(map_struct, shard);
+        resize_purge(map_struct, shard);
+
+        shard_write_unlock(shard);
+    }
+
+#ifdef THREAD_SAFETY
+    free(parts);
+#endif
+
+    return del_count;
+}
+
+static table_t *cursor_table(shard_t *shard, array_hashmap_cursor_t *cursor)
+{
+    return cursor->table ? &shard->table : &shard->old_table;
+}
+
+static int32_t cursor_range(array_hashmap_cursor_t *cursor, table_t *table, int32_t max_slots)
+{
+    int32_t begin = 0;
+    int32_t end = 0;
+
+    begin = (int64_t)table->map_size * cursor->part / cursor->parts;
+    end = (int64_t)table->map_size * (cursor->part + 1) / cursor->parts;
+
+    if (cursor->index < begin) {
+        cursor->index = begin;
+    }
+    if (end - cursor->index > max_slots) {
+        end = cursor->index + max_slots;
+    }
+
+    return end;
+}
+
+static array_hashmap_bool cursor_next(hashmap_t *map_struct, array_hashmap_cursor_t *cursor,
+                                      table_t *table)
+{
+    if (cursor->index < (int64_t)table->map_size * (cursor->part + 1) / cursor->parts) {
+        return 0;
+    }
+
+    cursor->index = 0;
+    cursor->table++;
+    if (cursor->table < 2) {
+        return 0;
+    }
+
+    cursor->table = 0;
+    cursor->shard++;
+    if (cursor->shard == map_struct->shard_count) {
+        cursor->shard = -1;
+    }
+
+    return 1;
+}
+
+array_hashmap_deled_count array_hashmap_del_elem_by_func_step(array_hashmap_t map_struct_c,
+                                                              del_func_t del_func,
+                                                              array_hashmap_cursor_t *cursor,
+                                                              int32_t max_slots)
+{
+    int32_t del_count = 0;
+    int32_t now_in_map = 0;
+    int32_t end = 0;
+
+    shard_t *shard = NULL;
+    table_t *table = NULL;
+
+    hashmap_t *map_struct = NULL;
+    map_struct = (hashmap_t *)map_struct_c;
+    if (!map_struct || (!del_func && !is_ttl()) || !cursor || max_slots <= 0) {
+        return array_hashmap_empty_args;
+    }
+
+    while (max_slots > 0 && cursor->shard >= 0) {
+        shard = &map_struct->shards[cursor->shard];
+
+        shard_write_lock(map_struct, shard);
+
+        now_in_map = all_in_map(shard);
+
+        table = cursor_table(shard, cursor);
+        end = cursor_range(cursor, table, max_slots);
+        if (cursor->index < end) {
+            max_slots -= end - cursor->index;
+            del_count +=
+                map_struct->engine->del_by_func(map_struct, table, cursor->index, end, del_func);
+            cursor->index = end;
+        }
+        migrate_unblock(shard, now_in_map);
+        if (cursor_next(map_struct, cursor, table)) {
+            if (is_str_key()) {
+                str_compact(map_struct, shard);
+            }
+            resize_shrink(map_struct, shard);
+            resize_purge(map_struct, shard);
+        }
+
+        shard_write_unlock(shard);
+    }
 
-    for (i = 0; i < map_struct->map_size; i++) {
-        elem_t *elem = elem_i(i);
-        elem->next = elem_empty;
+    return del_count;
+}
+
+array_hashmap_bool array_hashmap_cursor_init(array_hashmap_cursor_t *cursor, int32_t part,
+                                             int32_t parts, int32_t flags)
+{
+    if (!cursor || parts <= 0 || part < 0 || part >= parts) {
+        return 0;
     }
 
-    return (array_hashmap_t)map_struct;
+    cursor->part = part;
+    cursor->parts = parts;
+    cursor->flags = flags;
+    cursor->shard = 0;
+    cursor->table = 0;
+    cursor->index = 0;
+
+    return 1;
 }
 
-void array_hashmap_set_func(array_hashmap_t map_struct_c, add_hash_t add_hash, add_cmp_t add_cmp,
-                            find_hash_t find_hash, find_cmp_t find_cmp, del_hash_t del_hash,
-                            del_cmp_t del_cmp)
+array_hashmap_bool array_hashmap_cursor_is_end(const array_hashmap_cursor_t *cursor)
+{
+    return !cursor || cursor->shard < 0;
+}
+
+int32_t array_hashmap_foreach_step(array_hashmap_t map_struct_c, array_hashmap_cursor_t *cursor,
+                                   int32_t max_slots, foreach_func_t foreach_func, void *arg)
 {
+    int32_t visited = 0;
+    int32_t end = 0;
+    array_hashmap_bool is_stop = 0;
+    array_hashmap_bool is_shard_end = 0;
+
+    shard_t *shard = NULL;
+    table_t *table = NULL;
+
     hashmap_t *map_struct = NULL;
     map_struct = (hashmap_t *)map_struct_c;
-    if (!map_struct) {
-        return;
+    if (!map_struct || !cursor || !foreach_func || max_slots <= 0) {
+        return array_hashmap_empty_args;
     }
 
+    while (!is_stop && max_slots > 0 && cursor->shard >= 0) {
+        shard = &map_struct->shards[cursor->shard];
+
 #ifdef THREAD_SAFETY
-    pthread_rwlock_wrlock(&map_struct->rwlock);
+        if (!(cursor->flags & array_hashmap_cursor_no_lock)) {
+            shard_read_lock(map_struct, shard);
+        }
 #endif
 
-    map_struct->add_hash = add_hash;
-    map_struct->add_cmp = add_cmp;
-
-    map_struct->find_hash = find_hash;
-    map_struct->find_cmp = find_cmp;
-
-    map_struct->del_hash = del_hash;
-    map_struct->del_cmp = del_cmp;
+        /* Both arrays under one lock, a migration between them would show elements twice */
+        do {
+            table = cursor_table(shard, cursor);
+            end = cursor_range(cursor, table, max_slots);
+            if (cursor->index < end) {
+                max_slots -= end - cursor->index;
+                is_stop = map_struct->engine->foreach(map_struct, table, &cursor->index, end,
+                                                      time_now(), foreach_func, arg, &visited);
+            }
+            is_shard_end = cursor_next(map_struct, cursor, table);
+        } while (!is_shard_end && !is_stop && max_slots > 0);
 
 #ifdef THREAD_SAFETY
-    pthread_rwlock_unlock(&map_struct->rwlock);
+        if (!(cursor->flags & array_hashmap_cursor_no_lock)) {
+            pthread_rwlock_unlock(&shard->rwlock);
+        }
 #endif
+    }
+
+    return visited;
 }
 
-int32_t array_hashmap_now_in_map(array_hashmap_t map_struct_c)
+int32_t array_hashmap_foreach_part(array_hashmap_t map_struct_c, int32_t part, int32_t parts,
+                                   foreach_func_t foreach_func, void *arg)
 {
-    hashmap_t *map_struct = NULL;
-    map_struct = (hashmap_t *)map_struct_c;
-    if (!map_struct) {
+    array_hashmap_cursor_t cursor;
+
+    if (!array_hashmap_cursor_init(&cursor, part, parts, 0)) {
         return array_hashmap_empty_args;
     }
 
-    return map_struct->now_in_map;
+    return array_hashmap_foreach_step(map_struct_c, &cursor, INT32_MAX, foreach_func, arg);
 }
 
-array_hashmap_bool array_hashmap_is_thread_safety(array_hashmap_t map_struct_c)
+int32_t array_hashmap_foreach(array_hashmap_t map_struct_c, foreach_func_t foreach_func, void *arg)
 {
-    hashmap_t *map_struct = NULL;
-    map_struct = (hashmap_t *)map_struct_c;
-    if (!map_struct) {
-        return array_hashmap_empty_args;
-    }
-
-    return map_struct->is_thread_safety;
+    return array_hashmap_foreach_part(map_struct_c, 0, 1, foreach_func, arg);
 }
 
-array_hashmap_ret_t array_hashmap_add_elem(array_hashmap_t map_struct_c, const void *add_elem_data,
-                                           void *res_elem_data, on_already_in_t on_already_in)
+static array_hashmap_engine_t engine_id(hashmap_t *map_struct)
 {
-    int32_t add_elem_index = 0;
+    if (map_struct->engine == &swiss_engine) {
+        return array_hashmap_engine_swiss;
+    }
 
-    int32_t check_elem_index = 0;
-    elem_t *check_elem = NULL;
-    void *check_elem_data = NULL;
+    if (map_struct->engine == &cuckoo_engine) {
+        return array_hashmap_engine_cuckoo;
+    }
 
-    int32_t list_prev_elem_index = 0;
+    return array_hashmap_engine_chain;
+}
 
-    int32_t list_elem_index = 0;
-    elem_t *list_elem = NULL;
-    void *list_elem_data = NULL;
+static uint64_t snapshot_checksum(const snapshot_header_t *header,
+                                  const snapshot_table_t *tables)
+{
+    snapshot_header_t header_copy;
+    const uint8_t *bytes = NULL;
+    uint64_t checksum = UINT64_C(0xcbf29ce484222325);
+    size_t i = 0;
 
-    int32_t new_elem_index = 0;
-    elem_t *new_elem = NULL;
-    void *new_elem_data = NULL;
+    header_copy = *header;
+    header_copy.checksum = 0;
 
-    hashmap_t *map_struct = NULL;
-    map_struct = (hashmap_t *)map_struct_c;
-    if (!map_struct || !add_elem_data) {
-        return array_hashmap_empty_args;
+    bytes = (const uint8_t *)&header_copy;
+    for (i = 0; i < sizeof(header_copy); i++) {
+        checksum = (checksum ^ bytes[i]) * UINT64_C(0x100000001b3);
     }
 
-    if (!map_struct->add_hash || !map_struct->add_cmp) {
-        return array_hashmap_empty_funcs;
+    bytes = (const uint8_t *)tables;
+    for (i = 0; i < header->shard_count * sizeof(snapshot_table_t); i++) {
+        checksum = (checksum ^ bytes[i]) * UINT64_C(0x100000001b3);
     }
 
-#ifdef THREAD_SAFETY
-    pthread_rwlock_wrlock(&map_struct->rwlock);
-#endif
-
-    add_elem_index = index_add(add_elem_data);
-    check_elem = elem_i(add_elem_index);
-    check_elem_data = &check_elem->data;
-
-    if (check_elem->next == elem_empty) {
-        if (map_struct->now_in_map < map_struct->max_size) {
-            check_elem->next = elem_last;
-            memcpy(check_elem_data, add_elem_data, map_struct->data_size);
-
-            map_struct->now_in_map++;
+    return checksum;
+}
 
-#ifdef THREAD_SAFETY
-            pthread_rwlock_unlock(&map_struct->rwlock);
-#endif
-            return array_hashmap_elem_added;
-        } else {
-#ifdef THREAD_SAFETY
-            pthread_rwlock_unlock(&map_struct->rwlock);
-#endif
-            return array_hashmap_full;
-        }
-    } else {
-        check_elem_index = index_add(check_elem_data);
+static uint32_t snapshot_table_checksum(const char *map, size_t table_bytes)
+{
+    return hash_select(array_hashmap_hash_wy)(0, map, table_bytes);
+}
 
-        if (check_elem_index == add_elem_index) {
-            list_elem_index = check_elem_index;
+static array_hashmap_bool snapshot_write(hashmap_t *map_struct, FILE *file, uint32_t hash_id)
+{
+    snapshot_header_t header;
+    snapshot_table_t *tables = NULL;
+    array_hashmap_bool is_saved = 1;
 
-            do {
-                list_elem = elem_i(list_elem_index);
-                list_elem_data = &list_elem->data;
+    int64_t offset = 0;
+    size_t table_bytes = 0;
+    shard_t *shard = NULL;
+    int32_t i = 0;
 
-                if (map_struct->add_cmp(add_elem_data, list_elem_data)) {
-                    if (on_already_in) {
-                        if (on_already_in == array_hashmap_save_new_func) {
-                            memcpy(list_elem_data, add_elem_data, map_struct->data_size);
-                        } else {
-                            if (on_already_in(add_elem_data, list_elem_data)) {
-                                memcpy(list_elem_data, add_elem_data, map_struct->data_size);
-                            }
-                        }
-                    }
-                    if (res_elem_data) {
-                        memcpy(res_elem_data, list_elem_data, map_struct->data_size);
-                    }
-#ifdef THREAD_SAFETY
-                    pthread_rwlock_unlock(&map_struct->rwlock);
-#endif
-                    return array_hashmap_elem_already_in;
-                }
+    tables = calloc(map_struct->shard_count, sizeof(snapshot_table_t));
+    if (!tables) {
+        return 0;
+    }
 
-                list_prev_elem_index = list_elem_index;
-                list_elem_index = list_elem->next;
-            } while (list_elem_index != elem_last);
+    offset = page_align(sizeof(header) + map_struct->shard_count * sizeof(snapshot_table_t));
+    for (i = 0; is_saved && i < map_struct->shard_count; i++) {
+        shard = &map_struct->shards[i];
 
-            list_elem_index = list_prev_elem_index;
-            list_elem = elem_i(list_elem_index);
+        shard_write_lock(map_struct, shard);
 
-            if (map_struct->now_in_map < map_struct->max_size) {
-                new_elem_index = list_elem_index;
+        if (is_migrating(shard)) {
+            migrate_step(map_struct, shard, shard->old_table.map_size);
+        }
 
-                do {
-                    new_elem_index = (new_elem_index + 1) % map_struct->map_size;
-                    new_elem = elem_i(new_elem_index);
-                } while (new_elem->next != elem_empty);
+        table_bytes = map_struct->engine->table_bytes(map_struct, shard->table.map_size);
 
-                new_elem->next = elem_last;
-                new_elem_data = &new_elem->data;
-                memcpy(new_elem_data, add_elem_data, map_struct->data_size);
-                list_elem->next = new_elem_index;
+        tables[i].offset = offset;
+        tables[i].ctrl_offset = shard->table.ctrl ? (char *)shard->table.ctrl - shard->table.map
+                                                  : -1;
+        tables[i].map_size = shard->table.map_size;
+        tables[i].max_size = shard->table.max_size;
+        tables[i].now_in_map = shard->table.now_in_map;
+        tables[i].deleted = shard->table.deleted;
+        tables[i].table_checksum = snapshot_table_checksum(shard->table.map, table_bytes);
 
-                map_struct->now_in_map++;
+        /* Only one array is written, a stopped migration fails the save */
+        is_saved = !is_migrating(shard) && !fseek(file, offset, SEEK_SET) &&
+                   fwrite(shard->table.map, table_bytes, 1, file) == 1;
 
-#ifdef THREAD_SAFETY
-                pthread_rwlock_unlock(&map_struct->rwlock);
-#endif
-                return array_hashmap_elem_added;
-            } else {
-#ifdef THREAD_SAFETY
-                pthread_rwlock_unlock(&map_struct->rwlock);
-#endif
-                return array_hashmap_full;
-            }
-        } else {
-            if (map_struct->now_in_map < map_struct->max_size) {
-                list_elem = elem_i(check_elem_index);
-                while (list_elem->next != add_elem_index) {
-                    list_elem = elem_i(list_elem->next);
-                }
+        shard_write_unlock(shard);
 
-                new_elem_index = add_elem_index;
+        offset += page_align(table_bytes);
+    }
 
-                do {
-                    new_elem_index = (new_elem_index + 1) % map_struct->map_size;
-                    new_elem = elem_i(new_elem_index);
-                } while (new_elem->next != elem_empty);
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.hash_id = hash_id;
+    header.engine = engine_id(map_struct);
+    header.flags = map_struct->flags;
+    header.migrate_step = map_struct->migrate_step;
+    header.shard_count = map_struct->shard_count;
+    header.min_map_size = map_struct->min_map_size;
+    header.data_size = map_struct->data_size;
+    header.elem_size = map_struct->elem_size;
+    header.hash_func = map_struct->hash_func;
+    header.seed = map_struct->seed;
+    header.key_size = map_struct->key_size;
+    header.max_load = map_struct->max_load;
+    header.checksum = snapshot_checksum(&header, tables);
+
+    is_saved = is_saved && !fseek(file, 0, SEEK_SET) &&
+               fwrite(&header, sizeof(header), 1, file) == 1 &&
+               fwrite(tables, sizeof(snapshot_table_t), map_struct->shard_count, file) ==
+                   (size_t)map_struct->shard_count;
+
+    free(tables);
+    return is_saved;
+}
 
-                memcpy(new_elem, check_elem, map_struct->elem_size);
-                list_elem->next = new_elem_index;
+array_hashmap_bool array_hashmap_save(array_hashmap_t map_struct_c, const char *path,
+                                      uint32_t hash_id)
+{
+    array_hashmap_bool is_saved = 0;
+    char *tmp_path = NULL;
+    FILE *file = NULL;
 
-                check_elem->next = elem_last;
-                memcpy(check_elem_data, add_elem_data, map_struct->data_size);
+    hashmap_t *map_struct = NULL;
+    map_struct = (hashmap_t *)map_struct_c;
+    if (!map_struct || !path) {
+        return array_hashmap_empty_args;
+    }
 
-                map_struct->now_in_map++;
+    /* Long keys point into the arenas and string keys anywhere, neither is written */
+    if (is_str_key() || map_struct->key_size == array_hashmap_key_cstr) {
+        return 0;
+    }
 
-#ifdef THREAD_SAFETY
-                pthread_rwlock_unlock(&map_struct->rwlock);
-#endif
-                return array_hashmap_elem_added;
-            } else {
-#ifdef THREAD_SAFETY
-                pthread_rwlock_unlock(&map_struct->rwlock);
-#endif
-                return array_hashmap_full;
-            }
+    tmp_path = malloc(strlen(path) + sizeof(".tmp"));
+    if (!tmp_path) {
+        return 0;
+    }
+    strcpy(tmp_path, path);
+    strcat(tmp_path, ".tmp");
+
+    file = fopen(tmp_path, "wb");
+    if (file) {
+        is_saved = snapshot_write(map_struct, file, hash_id);
+        if (fclose(file)) {
+            is_saved = 0;
+        }
+        if (is_saved && rename(tmp_path, path)) {
+            is_saved = 0;
+        }
+        if (!is_saved) {
+            unlink(tmp_path);
         }
     }
+
+    free(tmp_path);
+    return is_saved;
 }
 
-array_hashmap_ret_t array_hashmap_find_elem(array_hashmap_t map_struct_c,
-                                            const void *find_elem_data, void *res_elem_data)
+static hashmap_t *snapshot_open(char *mapped, size_t mapped_size, uint32_t hash_id,
+                                array_hashmap_bool is_checked)
 {
-    int32_t find_elem_index = 0;
-    elem_t *find_elem = NULL;
+    const snapshot_header_t *header = NULL;
+    const snapshot_table_t *snapshot_tables = NULL;
+    table_t *tables = NULL;
+    array_hashmap_opts_t opts;
 
-    int32_t list_elem_index = 0;
-    elem_t *list_elem = NULL;
-    void *list_elem_data = NULL;
+    int64_t ctrl_offset = 0;
+    size_t table_bytes = 0;
+    int32_t i = 0;
 
     hashmap_t *map_struct = NULL;
-    map_struct = (hashmap_t *)map_struct_c;
-    if (!map_struct || !find_elem_data) {
-        return array_hashmap_empty_args;
+
+    header = (const snapshot_header_t *)mapped;
+    snapshot_tables = (const snapshot_table_t *)(header + 1);
+
+    if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) ||
+        header->hash_id != hash_id) {
+        return NULL;
     }
 
-    if (!map_struct->find_hash || !map_struct->find_cmp) {
-        return array_hashmap_empty_funcs;
+    if (header->shard_count <= 0 || header->shard_count > array_hashmap_max_shards ||
+        header->min_map_size <= 0 || header->min_map_size > INT32_MAX / header->shard_count) {
+        return NULL;
     }
 
-#ifdef THREAD_SAFETY
-    pthread_rwlock_rdlock(&map_struct->rwlock);
-#endif
+    if (sizeof(*header) + header->shard_count * sizeof(snapshot_table_t) > mapped_size ||
+        snapshot_checksum(header, snapshot_tables) != header->checksum) {
+        return NULL;
+    }
 
-    find_elem_index = index_find(find_elem_data);
-    find_elem = elem_i(find_elem_index);
+    memset(&opts, 0, sizeof(opts));
+    opts.flags = header->flags;
+    opts.migrate_step = header->migrate_step;
+    opts.shard_count = header->shard_count;
+    opts.engine = header->engine;
+    opts.hash_func = header->hash_func;
+    opts.seed = header->seed;
+    opts.key_size = header->key_size;
+
+    map_struct = hashmap_new(header->min_map_size * header->shard_count, header->max_load,
+                             header->data_size, &opts);
+    if (!map_struct) {
+        return NULL;
+    }
 
-    if (find_elem->next == elem_empty) {
-#ifdef THREAD_SAFETY
-        pthread_rwlock_unlock(&map_struct->rwlock);
-#endif
-        return array_hashmap_elem_not_finded;
+    tables = malloc(header->shard_count * sizeof(table_t));
+    if (!tables || map_struct->elem_size != header->elem_size) {
+        free(tables);
+        free(map_struct);
+        return NULL;
     }
 
-    list_elem_index = find_elem_index;
-    while (list_elem_index != elem_last) {
-        list_elem = elem_i(list_elem_index);
-        list_elem_data = &list_elem->data;
-        if (map_struct->find_cmp(find_elem_data, list_elem_data)) {
-            if (res_elem_data) {
-                memcpy(res_elem_data, list_elem_data, map_struct->data_size);
-            }
-#ifdef THREAD_SAFETY
-            pthread_rwlock_unlock(&map_struct->rwlock);
-#endif
-            return array_hashmap_elem_finded;
+    for (i = 0; i < header->shard_count; i++) {
+        const snapshot_table_t *snapshot_table = &snapshot_tables[i];
+
+        if (snapshot_table->map_size <= 0 || snapshot_table->now_in_map < 0 ||
+            snapshot_table->now_in_map > snapshot_table->map_size ||
+            snapshot_table->max_size < 0 || snapshot_table->max_size > snapshot_table->map_size ||
+            snapshot_table->deleted < 0 ||
+            snapshot_table->deleted > snapshot_table->map_size - snapshot_table->now_in_map) {
+            break;
+        }
+
+        table_bytes = map_struct->engine->table_bytes(map_struct, snapshot_table->map_size);
+        ctrl_offset = -1;
+        if (map_struct->engine != &chain_engine) {
+            ctrl_offset = (int64_t)snapshot_table->map_size * map_struct->elem_size;
         }
 
-        list_elem_index = list_elem->next;
+        if (snapshot_table->offset <= 0 || snapshot_table->offset % PAGE_ALIGN ||
+            snapshot_table->offset + table_bytes > mapped_size ||
+            snapshot_table->ctrl_offset != ctrl_offset) {
+            break;
+        }
+
+        /* The links and cells are trusted after open, check them if asked */
+        if (is_checked && snapshot_table_checksum(mapped + snapshot_table->offset, table_bytes) !=
+                              snapshot_table->table_checksum) {
+            break;
+        }
+
+        tables[i].map = mapped + snapshot_table->offset;
+        tables[i].ctrl = ctrl_offset < 0 ? NULL : (uint8_t *)tables[i].map + ctrl_offset;
+        tables[i].map_size = snapshot_table->map_size;
+        tables[i].max_size = snapshot_table->max_size;
+        tables[i].now_in_map = snapshot_table->now_in_map;
+        tables[i].deleted = snapshot_table->deleted;
     }
 
-#ifdef THREAD_SAFETY
-    pthread_rwlock_unlock(&map_struct->rwlock);
-#endif
-    return array_hashmap_elem_not_finded;
+    map_struct->mapped = mapped;
+    map_struct->mapped_size = mapped_size;
+
+    if (i < header->shard_count ||
+        !shards_init(map_struct, map_struct->min_map_size, tables)) {
+        free(tables);
+        free(map_struct);
+        return NULL;
+    }
+
+    free(tables);
+    return map_struct;
 }
 
-array_hashmap_ret_t array_hashmap_del_elem(array_hashmap_t map_struct_c, const void *del_elem_data,
-                                           void *res_elem_data)
+static array_hashmap_t snapshot_map(const char *path, uint32_t hash_id,
+                                    array_hashmap_bool is_checked)
 {
-    int32_t del_elem_index = 0;
-    elem_t *del_elem = NULL;
+    struct stat file_stat;
+    char *mapped = NULL;
+    int fd = 0;
+
+    hashmap_t *map_struct = NULL;
 
-    int32_t list_prev_elem_index = 0;
-    elem_t *list_prev_elem = NULL;
+    if (!path) {
+        return NULL;
+    }
 
-    int32_t list_next_elem_index = 0;
-    elem_t *list_next_elem = NULL;
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
 
-    int32_t list_elem_index = 0;
-    elem_t *list_elem = NULL;
-    void *list_elem_data = NULL;
+    if (fstat(fd, &file_stat) || file_stat.st_size < (off_t)sizeof(snapshot_header_t)) {
+        close(fd);
+        return NULL;
+    }
 
-    hashmap_t *map_struct = NULL;
-    map_struct = (hashmap_t *)map_struct_c;
-    if (!map_struct || !del_elem_data) {
-        return array_hashmap_empty_args;
+    mapped = mmap(NULL, file_stat.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        return NULL;
     }
 
-    if (!map_struct->del_hash || !map_struct->del_cmp) {
-        return array_hashmap_empty_funcs;
+    map_struct = snapshot_open(mapped, file_stat.st_size, hash_id, is_checked);
+    if (!map_struct) {
+        munmap(mapped, file_stat.st_size);
+        return NULL;
     }
 
-#ifdef THREAD_SAFETY
-    pthread_rwlock_wrlock(&map_struct->rwlock);
-#endif
+    return (array_hashmap_t)map_struct;
+}
+
+array_hashmap_t array_hashmap_open_mmap(const char *path, uint32_t hash_id)
+{
+    return snapshot_map(path, hash_id, 0);
+}
 
-    del_elem_index = index_del(del_elem_data);
-    del_elem = elem_i(del_elem_index);
+array_hashmap_t array_hashmap_open_mmap_checked(const char *path, uint32_t hash_id)
+{
+    return snapshot_map(path, hash_id, 1);
+}
 
-    if (del_elem->next == elem_empty) {
+static array_hashmap_bool shared_shards_init(hashmap_t *map_struct, char *region,
+                                             size_t table_bytes)
+{
 #ifdef THREAD_SAFETY
-        pthread_rwlock_unlock(&map_struct->rwlock);
+    pthread_rwlockattr_t attr;
 #endif
-        return array_hashmap_elem_not_deled;
-    }
-
-    list_prev_elem_index = elem_last;
-    list_elem_index = del_elem_index;
-    while (list_elem_index != elem_last) {
-        list_elem = elem_i(list_elem_index);
-        list_elem_data = &list_elem->data;
-        if (map_struct->del_cmp(del_elem_data, list_elem_data)) {
-            if (res_elem_data) {
-                memcpy(res_elem_data, list_elem_data, map_struct->data_size);
-            }
+    char *map = NULL;
+    int32_t i = 0;
 
-            if (list_elem->next == elem_last) {
-                if (list_prev_elem_index != elem_last) {
-                    list_prev_elem = elem_i(list_prev_elem_index);
-                    list_prev_elem->next = elem_last;
-                }
+    map_struct->shards = (shard_t *)(region + shared_shards_offset);
+    map = region + page_align(shared_shards_offset + map_struct->shard_count * sizeof(shard_t));
 
-                list_elem->next = elem_empty;
-            } else {
-                list_next_elem_index = list_elem->next;
-                list_next_elem = elem_i(list_next_elem_index);
+#ifdef THREAD_SAFETY
+    if (pthread_rwlockattr_init(&attr)) {
+        return 0;
+    }
+    if (pthread_rwlockattr_setpshared(&attr, PTHREAD_PROCESS_SHARED)) {
+        pthread_rwlockattr_destroy(&attr);
+        return 0;
+    }
+#endif
 
-                memcpy(list_elem, list_next_elem, map_struct->elem_size);
+    for (i = 0; i < map_struct->shard_count; i++) {
+        shard_t *shard = &map_struct->shards[i];
 
-                list_next_elem->next = elem_empty;
-            }
+        shard_reset(shard);
+        map_struct->engine->table_init(map_struct, &shard->table, map_struct->min_map_size,
+                                       map + i * table_bytes);
 
-            map_struct->now_in_map--;
 #ifdef THREAD_SAFETY
-            pthread_rwlock_unlock(&map_struct->rwlock);
-#endif
-            return array_hashmap_elem_deled;
+        if (pthread_rwlock_init(&shard->rwlock, &attr)) {
+            pthread_rwlockattr_destroy(&attr);
+            return 0;
         }
-
-        list_prev_elem_index = list_elem_index;
-        list_elem_index = list_elem->next;
+#endif
     }
 
 #ifdef THREAD_SAFETY
-    pthread_rwlock_unlock(&map_struct->rwlock);
+    pthread_rwlockattr_destroy(&attr);
 #endif
-    return array_hashmap_elem_not_deled;
+
+    return 1;
 }
 
-array_hashmap_deled_count array_hashmap_del_elem_by_func(array_hashmap_t map_struct_c,
-                                                         del_func_t del_func)
+static char *shared_create(hashmap_t *map_struct, const char *name)
 {
-    int32_t del_count = 0;
-    int32_t i = 0;
+    shared_header_t *header = NULL;
+    size_t table_bytes = 0;
+    size_t size = 0;
+    char *region = NULL;
+    int fd = 0;
+
+    table_bytes = page_align(
+        map_struct->engine->table_bytes(map_struct, map_struct->min_map_size));
+    size = page_align(shared_shards_offset + map_struct->shard_count * sizeof(shard_t)) +
+           map_struct->shard_count * table_bytes;
+
+    fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    if (ftruncate(fd, size)) {
+        close(fd);
+        shm_unlink(name);
+        return NULL;
+    }
+
+    region = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (region == MAP_FAILED) {
+        shm_unlink(name);
+        return NULL;
+    }
+
+    if (!shared_shards_init(map_struct, region, table_bytes)) {
+        munmap(region, size);
+        shm_unlink(name);
+        return NULL;
+    }
+
+    header = (shared_header_t *)region;
+    memcpy(header->magic, SHARED_MAGIC, sizeof(header->magic));
+    header->base = region;
+    header->size = size;
+    header->shard_size = sizeof(shard_t);
+    header->engine = engine_id(map_struct);
+    header->flags = map_struct->flags;
+    header->migrate_step = map_struct->migrate_step;
+    header->shard_count = map_struct->shard_count;
+    header->min_map_size = map_struct->min_map_size;
+    header->data_size = map_struct->data_size;
+    header->elem_size = map_struct->elem_size;
+    header->hash_func = map_struct->hash_func;
+    header->seed = map_struct->seed;
+    header->key_size = map_struct->key_size;
+    header->max_load = map_struct->max_load;
+    __atomic_store_n(&header->is_ready, 1, __ATOMIC_RELEASE);
+
+    map_struct->mapped = region;
+    map_struct->mapped_size = size;
+    map_struct->is_shared = 1;
+
+    return region;
+}
+
+array_hashmap_t array_hashmap_init_shared(const char *name, int32_t map_size, double max_load,
+                                          int32_t type_size, const array_hashmap_opts_t *opts)
+{
+    hashmap_t *map_struct = NULL;
+
+    if (!name) {
+        return NULL;
+    }
+
+    if (opts && (opts->flags & (array_hashmap_opt_grow | array_hashmap_opt_shrink |
+                                array_hashmap_opt_optimistic_read | array_hashmap_opt_str_key))) {
+        return NULL;
+    }
+
+    if (opts && opts->key_size == array_hashmap_key_cstr) {
+        return NULL;
+    }
+
+    if (opts && opts->alloc_func) {
+        return NULL;
+    }
 
-    int32_t elem_index = 0;
-    elem_t *elem = NULL;
-    void *elem_data = NULL;
+    map_struct = hashmap_new(map_size, max_load, type_size, opts);
+    if (!map_struct) {
+        return NULL;
+    }
 
-    int32_t list_prev_elem_index = 0;
-    elem_t *list_prev_elem = NULL;
+    if (!shared_create(map_struct, name)) {
+        free(map_struct);
+        return NULL;
+    }
 
-    int32_t list_next_elem_index = 0;
-    elem_t *list_next_elem = NULL;
+    return (array_hashmap_t)map_struct;
+}
 
-    int32_t list_elem_index = 0;
-    elem_t *list_elem = NULL;
-    void *list_elem_data = NULL;
+array_hashmap_t array_hashmap_attach_shared(const char *name)
+{
+    const shared_header_t *header = NULL;
+    shared_header_t header_copy;
+    array_hashmap_opts_t opts;
+    char *region = NULL;
+    int fd = 0;
 
     hashmap_t *map_struct = NULL;
-    map_struct = (hashmap_t *)map_struct_c;
-    if (!map_struct || !del_func) {
-        return array_hashmap_empty_args;
+
+    if (!name) {
+        return NULL;
     }
 
-#ifdef THREAD_SAFETY
-    pthread_rwlock_wrlock(&map_struct->rwlock);
-#endif
+    fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0) {
+        return NULL;
+    }
 
-    for (i = 0; i < map_struct->map_size; i++) {
-        elem = elem_i(i);
-        if (elem->next == elem_empty) {
-            continue;
-        }
+    if (pread(fd, &header_copy, sizeof(header_copy), 0) != sizeof(header_copy) ||
+        memcmp(header_copy.magic, SHARED_MAGIC, sizeof(header_copy.magic))) {
+        close(fd);
+        return NULL;
+    }
 
-        elem_data = &elem->data;
+    region = mmap(header_copy.base, header_copy.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (region == MAP_FAILED) {
+        return NULL;
+    }
 
-        elem_index = index_add(elem_data);
-        if (elem_index != i) {
-            continue;
-        }
+    header = (const shared_header_t *)region;
+    if (region != header_copy.base || !__atomic_load_n(&header->is_ready, __ATOMIC_ACQUIRE) ||
+        header->shard_size != sizeof(shard_t)) {
+        munmap(region, header_copy.size);
+        return NULL;
+    }
 
-        list_prev_elem_index = elem_last;
-        list_elem_index = elem_index;
-        while (list_elem_index != elem_last) {
-            list_elem = elem_i(list_elem_index);
-            list_elem_data = &list_elem->data;
-            if (del_func(list_elem_data)) {
-                if (list_elem->next == elem_last) {
-                    if (list_prev_elem_index != elem_last) {
-                        list_prev_elem = elem_i(list_prev_elem_index);
-                        list_prev_elem->next = elem_last;
-                    }
-
-                    list_elem->next = elem_empty;
-                    list_elem_index = elem_last;
-                } else {
-                    list_next_elem_index = list_elem->next;
-                    list_next_elem = elem_i(list_next_elem_index);
-
-                    memcpy(list_elem, list_next_elem, map_struct->elem_size);
-
-                    list_next_elem->next = elem_empty;
-                }
-
-                del_count++;
-                map_struct->now_in_map--;
-            } else {
-                list_prev_elem_index = list_elem_index;
-                list_elem_index = list_elem->next;
-            }
-        }
+    memset(&opts, 0, sizeof(opts));
+    opts.flags = header->flags;
+    opts.migrate_step = header->migrate_step;
+    opts.shard_count = header->shard_count;
+    opts.engine = header->engine;
+    opts.hash_func = header->hash_func;
+    opts.seed = header->seed;
+    opts.key_size = header->key_size;
+
+    map_struct = hashmap_new(header->min_map_size * header->shard_count, header->max_load,
+                             header->data_size, &opts);
+    if (!map_struct || map_struct->elem_size != header->elem_size) {
+        free(map_struct);
+        munmap(region, header_copy.size);
+        return NULL;
     }
 
-#ifdef THREAD_SAFETY
-    pthread_rwlock_unlock(&map_struct->rwlock);
-#endif
-    return del_count;
+    map_struct->shards = (shard_t *)(region + shared_shards_offset);
+    map_struct->mapped = region;
+    map_struct->mapped_size = header_copy.size;
+    map_struct->is_shared = 1;
+
+    return (array_hashmap_t)map_struct;
 }
 
 void array_hashmap_del(array_hashmap_t *map_struct_c)
@@ -544,10 +2309,22 @@ void array_hashmap_del(array_hashmap_t *map_struct_c)
     sleep(1);
 #endif
 
-    free(map_struct->map);
+    if (map_struct->is_shared) {
+        munmap(map_struct->mapped, map_struct->mapped_size);
+#ifdef LATENCY_STATS
+        latency_free(map_struct);
+#endif
+        free(map_struct);
+        return;
+    }
 
-#ifdef THREAD_SAFETY
-    pthread_rwlock_destroy(&map_struct->rwlock);
+#ifdef LATENCY_STATS
+    latency_free(map_struct);
 #endif
+
+    shards_free(map_struct, map_struct->shard_count);
+    if (map_struct->mapped) {
+        munmap(map_struct->mapped, map_struct->mapped_size);
+    }
     free(map_struct);
 }
@@ -0,0 +1,711 @@
+#include "array_hashmap_internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct __attribute__((packed)) elem {
+    int32_t next;
+    array_hashmap_hash hash;
+} elem_t;
+
+enum next { elem_empty = -2, elem_last = -1 };
+
+#define DATA_ALIGN 64
+
+#define elem_i(table, index) ((elem_t *)&(table)->map[(size_t)(index) * map_struct->elem_size])
+#define data_start(map_size) \
+    (((size_t)(map_size) * map_struct->elem_size + DATA_ALIGN - 1) & ~(size_t)(DATA_ALIGN - 1))
+#define data_base(table) (is_split_data() ? data_start((table)->map_size) : 0)
+#define data_i(table, index)                                                      \
+    (&(table)->map[data_base(table) + (size_t)(index) * map_struct->data_stride + \
+                   map_struct->data_offset])
+#define elem_hash(table, index) \
+    (is_store_hash() ? elem_i(table, index)->hash : elem_add_hash(data_i(table, index)))
+#define elem_hash_differs(elem, elem_hash) (is_store_hash() && (elem)->hash != (elem_hash))
+#define elem_next_once(elem) (((volatile elem_t *)(elem))->next)
+
+static size_t chain_table_bytes(hashmap_t *map_struct, int32_t map_size)
+{
+    if (is_split_data()) {
+        return data_start(map_size) + (size_t)map_size * map_struct->data_stride;
+    }
+
+    return (size_t)map_size * map_struct->elem_size;
+}
+
+static array_hashmap_bool chain_table_init(hashmap_t *map_struct, table_t *table, int32_t map_size,
+                                           char *map)
+{
+    int32_t i = 0;
+
+    table->map = map ? map : table_alloc(chain_table_bytes(map_struct, map_size));
+    if (!table->map) {
+        return 0;
+    }
+
+    table->ctrl = NULL;
+    table->map_size = map_size;
+    table->max_size = map_size * map_struct->max_load;
+    table->now_in_map = 0;
+    table->deleted = 0;
+
+    for (i = 0; i < table->map_size; i++) {
+        elem_t *elem = elem_i(table, i);
+        elem->next = elem_empty;
+    }
+
+    return 1;
+}
+
+static int32_t chain_free_index(hashmap_t *map_struct, table_t *table, int32_t index)
+{
+    int32_t distance = 0;
+    elem_t *elem = NULL;
+
+    do {
+        index++;
+        if (index == table->map_size) {
+            index = 0;
+        }
+        elem = elem_i(table, index);
+        distance++;
+    } while (elem->next != elem_empty);
+
+    stat_add(stat_free_search, 1);
+    stat_add(stat_free_distance, distance);
+
+    return index;
+}
+
+static void elem_set(hashmap_t *map_struct, table_t *table, int32_t index, int32_t next,
+                     array_hashmap_hash add_hash, const void *add_elem_data,
+                     array_hashmap_time expire)
+{
+    elem_t *elem = NULL;
+    char *data = NULL;
+
+    elem = elem_i(table, index);
+    data = data_i(table, index);
+
+    elem->next = next;
+    if (is_store_hash()) {
+        elem->hash = add_hash;
+    }
+    if (is_ttl()) {
+        data_expire(data) = expire;
+    }
+    memcpy(data, add_elem_data, map_struct->data_size);
+}
+
+static void elem_copy(hashmap_t *map_struct, table_t *table, int32_t to_index,
+                      int32_t from_index)
+{
+    memcpy(elem_i(table, to_index), elem_i(table, from_index), map_struct->elem_size);
+    if (is_split_data()) {
+        memcpy(data_i(table, to_index) - map_struct->data_offset,
+               data_i(table, from_index) - map_struct->data_offset, map_struct->data_stride);
+    }
+}
+
+static int32_t chain_append(hashmap_t *map_struct, table_t *table, int32_t list_elem_index,
+                            array_hashmap_hash add_hash, const void *add_elem_data,
+                            array_hashmap_time expire)
+{
+    elem_t *list_elem = NULL;
+
+    int32_t new_elem_index = 0;
+
+    list_elem = elem_i(table, list_elem_index);
+
+    new_elem_index = chain_free_index(map_struct, table, list_elem_index);
+
+    elem_set(map_struct, table, new_elem_index, elem_last, add_hash, add_elem_data, expire);
+    list_elem->next = new_elem_index;
+
+    table->now_in_map++;
+
+    return new_elem_index;
+}
+
+static void chain_displace(hashmap_t *map_struct, table_t *table, int32_t add_elem_index,
+                           int32_t check_elem_index, array_hashmap_hash add_hash,
+                           const void *add_elem_data, array_hashmap_time expire)
+{
+    elem_t *list_elem = NULL;
+
+    int32_t new_elem_index = 0;
+
+    list_elem = elem_i(table, check_elem_index);
+    while (list_elem->next != add_elem_index) {
+        list_elem = elem_i(table, list_elem->next);
+    }
+
+    new_elem_index = chain_free_index(map_struct, table, add_elem_index);
+
+    elem_copy(map_struct, table, new_elem_index, add_elem_index);
+    list_elem->next = new_elem_index;
+    stat_add(stat_displace, 1);
+
+    elem_set(map_struct, table, add_elem_index, elem_last, add_hash, add_elem_data, expire);
+
+    table->now_in_map++;
+}
+
+static void chain_insert(hashmap_t *map_struct, table_t *table, array_hashmap_hash add_hash,
+                         const void *add_elem_data, array_hashmap_time expire)
+{
+    int32_t add_elem_index = 0;
+
+    int32_t check_elem_index = 0;
+    elem_t *check_elem = NULL;
+
+    int32_t list_elem_index = 0;
+    elem_t *list_elem = NULL;
+
+    add_elem_index = index_hash(table, add_hash);
+    check_elem = elem_i(table, add_elem_index);
+
+    if (check_elem->next == elem_empty) {
+        elem_set(map_struct, table, add_elem_index, elem_last, add_hash, add_elem_data, expire);
+
+        table->now_in_map++;
+        return;
+    }
+
+    check_elem_index = index_hash(table, elem_hash(table, add_elem_index));
+    if (check_elem_index != add_elem_index) {
+        chain_displace(map_struct, table, add_elem_index, check_elem_index, add_hash,
+                       add_elem_data, expire);
+        return;
+    }
+
+    list_elem_index = add_elem_index;
+    list_elem = check_elem;
+    while (list_elem->next != elem_last) {
+        list_elem_index = list_elem->next;
+        list_elem = elem_i(table, list_elem_index);
+    }
+
+    chain_append(map_struct, table, list_elem_index, add_hash, add_elem_data, expire);
+}
+
+static void chain_unlink(hashmap_t *map_struct, table_t *table, int32_t list_prev_elem_index,
+                         int32_t list_elem_index)
+{
+    elem_t *list_elem = NULL;
+    elem_t *list_prev_elem = NULL;
+
+    int32_t list_next_elem_index = 0;
+
+    list_elem = elem_i(table, list_elem_index);
+
+    if (list_elem->next == elem_last) {
+        if (list_prev_elem_index != elem_last) {
+            list_prev_elem = elem_i(table, list_prev_elem_index);
+            list_prev_elem->next = elem_last;
+        }
+
+        list_elem->next = elem_empty;
+    } else {
+        list_next_elem_index = list_elem->next;
+
+        elem_copy(map_struct, table, list_elem_index, list_next_elem_index);
+
+        elem_i(table, list_next_elem_index)->next = elem_empty;
+    }
+
+    table->now_in_map--;
+}
+
+static array_hashmap_ret_t chain_add(hashmap_t *map_struct, shard_t *shard,
+                                     array_hashmap_hash add_hash, const void *add_elem_data,
+                                     void *res_elem_data, on_already_in_t on_already_in,
+                                     array_hashmap_time expire, void **hashmap_elem_data)
+{
+    table_t *table = NULL;
+    array_hashmap_time now = 0;
+
+    int32_t add_elem_index = 0;
+
+    int32_t check_elem_index = 0;
+    elem_t *check_elem = NULL;
+
+    int32_t list_prev_elem_index = 0;
+
+    int32_t list_elem_index = 0;
+    elem_t *list_elem = NULL;
+    void *list_elem_data = NULL;
+    array_hashmap_bool is_last = 0;
+
+    table = &shard->table;
+    now = time_now();
+
+    add_elem_index = index_hash(table, add_hash);
+    check_elem = elem_i(table, add_elem_index);
+
+    if (check_elem->next != elem_empty) {
+        check_elem_index = index_hash(table, elem_hash(table, add_elem_index));
+
+        if (check_elem_index != add_elem_index) {
+            if (all_in_map(shard) < table->max_size) {
+                chain_displace(map_struct, table, add_elem_index, check_elem_index, add_hash,
+                               add_elem_data, expire);
+                *hashmap_elem_data = data_i(table, add_elem_index);
+                return array_hashmap_elem_added;
+            } else {
+                return array_hashmap_full;
+            }
+        }
+
+        list_prev_elem_index = elem_last;
+        list_elem_index = check_elem_index;
+        do {
+            list_elem = elem_i(table, list_elem_index);
+            list_elem_data = data_i(table, list_elem_index);
+
+            if (!elem_hash_differs(list_elem, add_hash) &&
+                stat_cmp(stat_add_cmp, map_struct->add_cmp, add_elem_data, list_elem_data)) {
+                *hashmap_elem_data = list_elem_data;
+                if (data_is_expired(list_elem_data, now)) {
+                    elem_set(map_struct, table, list_elem_index, list_elem->next, add_hash,
+                             add_elem_data, expire);
+                    return array_hashmap_elem_added;
+                }
+
+                hashmap_already_in(map_struct, list_elem_data, add_elem_data, res_elem_data,
+                                   on_already_in, expire);
+                return array_hashmap_elem_already_in;
+            }
+
+            if (data_is_expired(list_elem_data, now)) {
+                is_last = list_elem->next == elem_last;
+
+                chain_unlink(map_struct, table, list_prev_elem_index, list_elem_index);
+                if (is_last) {
+                    list_elem_index = elem_last;
+                }
+
+                continue;
+            }
+
+            list_prev_elem_index = list_elem_index;
+            list_elem_index = list_elem->next;
+        } while (list_elem_index != elem_last);
+
+        if (list_prev_elem_index != elem_last) {
+            if (all_in_map(shard) < table->max_size) {
+                list_elem_index = chain_append(map_struct, table, list_prev_elem_index, add_hash,
+                                               add_elem_data, expire);
+                *hashmap_elem_data = data_i(table, list_elem_index);
+                return array_hashmap_elem_added;
+            } else {
+                return array_hashmap_full;
+            }
+        }
+    }
+
+    if (all_in_map(shard) < table->max_size) {
+        elem_set(map_struct, table, add_elem_index, elem_last, add_hash, add_elem_data, expire);
+        *hashmap_elem_data = data_i(table, add_elem_index);
+
+        table->now_in_map++;
+
+        return array_hashmap_elem_added;
+    } else {
+        return array_hashmap_full;
+    }
+}
+
+static void *chain_find(hashmap_t *map_struct, table_t *table, array_hashmap_hash find_hash,
+                        const void *find_elem_data)
+{
+    int32_t find_elem_index = 0;
+    elem_t *find_elem = NULL;
+
+    int32_t list_elem_index = 0;
+    elem_t *list_elem = NULL;
+    void *list_elem_data = NULL;
+
+    find_elem_index = index_hash(table, find_hash);
+    find_elem = elem_i(table, find_elem_index);
+
+    if (find_elem->next == elem_empty) {
+        return NULL;
+    }
+
+    list_elem_index = find_elem_index;
+    while (list_elem_index != elem_last) {
+        list_elem = elem_i(table, list_elem_index);
+        list_elem_data = data_i(table, list_elem_index);
+        if (!elem_hash_differs(list_elem, find_hash) &&
+            stat_cmp(stat_find_cmp, map_struct->find_cmp, find_elem_data, list_elem_data)) {
+            if (data_is_expired(list_elem_data, time_now())) {
+                return NULL;
+            }
+            return list_elem_data;
+        }
+
+        list_elem_index = list_elem->next;
+    }
+
+    return NULL;
+}
+
+static array_hashmap_ret_t chain_del(hashmap_t *map_struct, table_t *table,
+                                     array_hashmap_hash del_hash, const void *del_elem_data,
+                                     void *res_elem_data)
+{
+    int32_t del_elem_index = 0;
+    elem_t *del_elem = NULL;
+
+    int32_t list_prev_elem_index = 0;
+
+    int32_t list_elem_index = 0;
+    elem_t *list_elem = NULL;
+    void *list_elem_data = NULL;
+
+    del_elem_index = index_hash(table, del_hash);
+    del_elem = elem_i(table, del_elem_index);
+
+    if (del_elem->next == elem_empty) {
+        return array_hashmap_elem_not_deled;
+    }
+
+    list_prev_elem_index = elem_last;
+    list_elem_index = del_elem_index;
+    while (list_elem_index != elem_last) {
+        list_elem = elem_i(table, list_elem_index);
+        list_elem_data = data_i(table, list_elem_index);
+        if (!elem_hash_differs(list_elem, del_hash) &&
+            stat_cmp(stat_del_cmp, map_struct->del_cmp, del_elem_data, list_elem_data)) {
+            if (data_is_expired(list_elem_data, time_now())) {
+                chain_unlink(map_struct, table, list_prev_elem_index, list_elem_index);
+                return array_hashmap_elem_not_deled;
+            }
+
+            if (res_elem_data) {
+                memcpy(res_elem_data, list_elem_data, map_struct->data_size);
+            }
+
+            chain_unlink(map_struct, table, list_prev_elem_index, list_elem_index);
+
+            return array_hashmap_elem_deled;
+        }
+
+        list_prev_elem_index = list_elem_index;
+        list_elem_index = list_elem->next;
+    }
+
+    return array_hashmap_elem_not_deled;
+}
+
+static array_hashmap_ret_t chain_find_once(hashmap_t *map_struct, table_t *table,
+                                           array_hashmap_hash find_hash,
+                                           const void *find_elem_data, void *res_elem_data)
+{
+    int32_t steps = 0;
+
+    int32_t list_elem_index = 0;
+    int32_t list_next_elem_index = 0;
+    elem_t *list_elem = NULL;
+    void *list_elem_data = NULL;
+
+    list_elem_index = index_hash(table, find_hash);
+    list_elem = elem_i(table, list_elem_index);
+
+    if (elem_next_once(list_elem) == elem_empty) {
+        return array_hashmap_elem_not_finded;
+    }
+
+    for (steps = 0; steps < table->map_size; steps++) {
+        list_elem = elem_i(table, list_elem_index);
+        list_elem_data = data_i(table, list_elem_index);
+
+        list_next_elem_index = elem_next_once(list_elem);
+        if (list_next_elem_index < elem_last || list_next_elem_index >= table->map_size) {
+            return optimistic_retry;
+        }
+
+        if (!elem_hash_differs(list_elem, find_hash) &&
+            stat_cmp(stat_find_cmp, map_struct->find_cmp, find_elem_data, list_elem_data)) {
+            if (data_is_expired(list_elem_data, time_now())) {
+                return array_hashmap_elem_not_finded;
+            }
+            if (res_elem_data) {
+                memcpy(res_elem_data, list_elem_data, map_struct->data_size);
+            }
+            return array_hashmap_elem_finded;
+        }
+
+        if (list_next_elem_index == elem_last) {
+            return array_hashmap_elem_not_finded;
+        }
+
+        list_elem_index = list_next_elem_index;
+    }
+
+    return optimistic_retry;
+}
+
+static void chain_del_mark(hashmap_t *map_struct, table_t *table, int32_t from, int32_t to,
+                           del_func_t del_func, uint8_t *marks)
+{
+    array_hashmap_time now = 0;
+    elem_t *elem = NULL;
+    int32_t i = 0;
+
+    now = time_now();
+
+    for (i = from; i < to; i++) {
+        marks[i] = 0;
+
+        elem = elem_i(table, i);
+        if (elem->next == elem_empty) {
+            continue;
+        }
+
+        if (index_hash(table, elem_hash(table, i)) == i) {
+            marks[i] |= mark_head;
+        }
+        if (data_is_del(data_i(table, i), del_func, now)) {
+            marks[i] |= mark_del;
+        }
+    }
+}
+
+static int32_t chain_del_marked(hashmap_t *map_struct, table_t *table, int32_t from, int32_t to,
+                                const uint8_t *marks)
+{
+    int32_t del_count = 0;
+    int32_t i = 0;
+
+    int32_t list_prev_elem_index = 0;
+
+    int32_t list_elem_index = 0;
+    int32_t list_elem_mark_index = 0;
+    elem_t *list_elem = NULL;
+    array_hashmap_bool is_last = 0;
+
+    for (i = from; i < to; i++) {
+        if (!(marks[i] & mark_head)) {
+            continue;
+        }
+
+        list_prev_elem_index = elem_last;
+        list_elem_index = i;
+        list_elem_mark_index = i;
+        while (list_elem_index != elem_last) {
+            list_elem = elem_i(table, list_elem_index);
+            if (marks[list_elem_mark_index] & mark_del) {
+                is_last = list_elem->next == elem_last;
+                list_elem_mark_index = list_elem->next;
+
+                chain_unlink(map_struct, table, list_prev_elem_index, list_elem_index);
+                if (is_last) {
+                    list_elem_index = elem_last;
+                }
+
+                del_count++;
+            } else {
+                list_prev_elem_index = list_elem_index;
+                list_elem_index = list_elem->next;
+                list_elem_mark_index = list_elem_index;
+            }
+        }
+    }
+
+    return del_count;
+}
+
+static array_hashmap_bool chain_foreach(hashmap_t *map_struct, table_t *table, int32_t *index,
+                                        int32_t end, array_hashmap_time now,
+                                        foreach_func_t foreach_func, void *arg, int32_t *visited)
+{
+    elem_t *elem = NULL;
+    char *data = NULL;
+
+    while (*index < end) {
+        elem = elem_i(table, *index);
+        data = data_i(table, *index);
+        (*index)++;
+
+        if (elem->next == elem_empty || data_is_expired(data, now)) {
+            continue;
+        }
+
+        (*visited)++;
+        if (foreach_func(data, arg) == array_hashmap_foreach_stop) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static void chain_prefetch(hashmap_t *map_struct, table_t *table, array_hashmap_hash hash,
+                           int32_t depth)
+{
+    int32_t index = 0;
+
+    index = index_hash(table, hash);
+    if (depth) {
+        index = elem_i(table, index)->next;
+        if (index < 0) {
+            return;
+        }
+    }
+
+    __builtin_prefetch(elem_i(table, index));
+    if (is_split_data()) {
+        __builtin_prefetch(data_i(table, index));
+    }
+}
+
+static array_hashmap_bool chain_migrate(hashmap_t *map_struct, shard_t *shard, int32_t index)
+{
+    table_t *old_table = NULL;
+    array_hashmap_time now = 0;
+
+    int32_t elem_index = 0;
+    elem_t *elem = NULL;
+
+    int32_t list_elem_index = 0;
+    elem_t *list_elem = NULL;
+    char *list_elem_data = NULL;
+
+    old_table = &shard->old_table;
+
+    elem = elem_i(old_table, index);
+    if (elem->next == elem_empty) {
+        return 1;
+    }
+
+    elem_index = index_hash(old_table, elem_hash(old_table, index));
+    if (elem_index != index) {
+        return 1;
+    }
+
+    now = time_now();
+
+    list_elem_index = index;
+    while (list_elem_index != elem_last) {
+        list_elem = elem_i(old_table, list_elem_index);
+        list_elem_data = data_i(old_table, list_elem_index);
+
+        if (!data_is_expired(list_elem_data, now)) {
+            chain_insert(map_struct, &shard->table, elem_hash(old_table, list_elem_index),
+                         list_elem_data,
+                         is_ttl() ? data_expire(list_elem_data) : array_hashmap_no_expire);
+        }
+
+        list_elem_index = list_elem->next;
+        list_elem->next = elem_empty;
+        old_table->now_in_map--;
+    }
+
+    return 1;
+}
+
+static void chain_migrate_key(hashmap_t *map_struct, shard_t *shard, array_hashmap_hash hash,
+                              const void *elem_data, cmp_t cmp, int32_t cmp_stat)
+{
+    int32_t index = 0;
+
+    (void)elem_data;
+    (void)cmp;
+    (void)cmp_stat;
+
+    index = index_hash(&shard->old_table, hash);
+    if (index >= shard->migrate_index) {
+        chain_migrate(map_struct, shard, index);
+    }
+}
+
+static int32_t chain_del_by_func(hashmap_t *map_struct, table_t *table, int32_t from,
+                                 int32_t to, del_func_t del_func)
+{
+    array_hashmap_time now = 0;
+    int32_t del_count = 0;
+    int32_t i = 0;
+
+    int32_t elem_index = 0;
+    elem_t *elem = NULL;
+
+    int32_t list_prev_elem_index = 0;
+
+    int32_t list_elem_index = 0;
+    elem_t *list_elem = NULL;
+    void *list_elem_data = NULL;
+    array_hashmap_bool is_last = 0;
+
+    now = time_now();
+
+    for (i = from; i < to; i++) {
+        elem = elem_i(table, i);
+        if (elem->next == elem_empty) {
+            continue;
+        }
+
+        elem_index = index_hash(table, elem_hash(table, i));
+        if (elem_index != i) {
+            continue;
+        }
+
+        list_prev_elem_index = elem_last;
+        list_elem_index = elem_index;
+        while (list_elem_index != elem_last) {
+            list_elem = elem_i(table, list_elem_index);
+            list_elem_data = data_i(table, list_elem_index);
+            if (data_is_del(list_elem_data, del_func, now)) {
+                is_last = list_elem->next == elem_last;
+
+                chain_unlink(map_struct, table, list_prev_elem_index, list_elem_index);
+                if (is_last) {
+                    list_elem_index = elem_last;
+                }
+
+                del_count++;
+            } else {
+                list_prev_elem_index = list_elem_index;
+                list_elem_index = list_elem->next;
+            }
+        }
+    }
+
+    return del_count;
+}
+
+static void chain_stats(hashmap_t *map_struct, table_t *table, array_hashmap_stats_t *stats)
+{
+    int32_t i = 0;
+    int32_t length = 0;
+
+    int32_t list_elem_index = 0;
+    elem_t *elem = NULL;
+
+    for (i = 0; i < table->map_size; i++) {
+        elem = elem_i(table, i);
+        if (elem->next == elem_empty) {
+            continue;
+        }
+
+        if (index_hash(table, elem_hash(table, i)) != i) {
+            stats->non_owner_count++;
+            continue;
+        }
+
+        length = 0;
+        list_elem_index = i;
+        while (list_elem_index != elem_last) {
+            length++;
+            list_elem_index = elem_i(table, list_elem_index)->next;
+        }
+
+        stats_chain_add(stats, length);
+    }
+}
+
+const engine_t chain_engine = { sizeof(int32_t),  chain_table_init,  chain_table_bytes,
+                                chain_add,        chain_find,        chain_find_once,
+                                chain_del,        chain_del_by_func, chain_del_mark,
+                                chain_del_marked, chain_foreach,     chain_prefetch,
+                                chain_migrate,    chain_migrate_key, chain_stats };
@@ -0,0 +1,563 @@
+#include "array_hashmap_internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define BUCKET_SLOTS 8
+#define CUCKOO_MAX_LOAD 0.98
+#define CUCKOO_SEARCH 256
+
+#define GROUP_LSB UINT64_C(0x0101010101010101)
+#define GROUP_MSB UINT64_C(0x8080808080808080)
+
+typedef struct __attribute__((packed)) slot {
+    array_hashmap_hash hash;
+} slot_t;
+
+typedef struct search_node {
+    int32_t bucket;
+    int16_t parent;
+    int16_t slot;
+} search_node_t;
+
+enum ctrl { ctrl_empty = 0x80 };
+
+#define slot_i(table, index) ((slot_t *)&(table)->map[(size_t)(index) * map_struct->elem_size])
+#define slot_hash(slot) (is_store_hash() ? (slot)->hash : elem_add_hash(elem_data(slot)))
+#define slot_hash_differs(slot, slot_hash) (is_store_hash() && (slot)->hash != (slot_hash))
+#define is_full(ctrl) (!((ctrl) & 0x80))
+#define hash_tag(hash) ((uint8_t)((hash) & 0x7f))
+
+/* The last bucket is the stash for the elements that found no place in their two buckets */
+#define bucket_count(table) ((table)->map_size / BUCKET_SLOTS - 1)
+#define stash_bucket(table) bucket_count(table)
+#define bucket_hash(table, hash)                                                               \
+    ((int32_t)(((uint64_t)(uint32_t)((hash) << map_struct->shard_bits) * bucket_count(table)) >> \
+               32))
+#define group_slot(mask) (__builtin_ctzll(mask) >> 3)
+
+/* Rounding is idempotent, so the bytes are the same for the asked and the final size */
+#define table_size(map_size)                                                                 \
+    ((map_size) < BUCKET_SLOTS * 2 ? BUCKET_SLOTS * 2                                        \
+                                   : ((map_size) + BUCKET_SLOTS - 1) / BUCKET_SLOTS * BUCKET_SLOTS)
+
+static void bucket_pair(hashmap_t *map_struct, table_t *table, array_hashmap_hash hash,
+                        int32_t *buckets)
+{
+    buckets[0] = bucket_hash(table, hash);
+    buckets[1] = bucket_hash(table, hash_mix(hash));
+    if (buckets[1] == buckets[0]) {
+        buckets[1] = buckets[0] + 1 < bucket_count(table) ? buckets[0] + 1 : 0;
+    }
+}
+
+static uint64_t group_load(table_t *table, int32_t bucket)
+{
+    uint64_t group = 0;
+
+    memcpy(&group, &table->ctrl[(size_t)bucket * BUCKET_SLOTS], sizeof(group));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    group = __builtin_bswap64(group);
+#endif
+
+    return group;
+}
+
+/* May also match a full slot after a matched one, the compare drops it */
+static uint64_t group_match(uint64_t group, uint8_t tag)
+{
+    group ^= GROUP_LSB * tag;
+
+    return (group - GROUP_LSB) & ~group & GROUP_MSB;
+}
+
+static uint64_t group_match_free(uint64_t group)
+{
+    return group & GROUP_MSB;
+}
+
+static size_t cuckoo_table_bytes(hashmap_t *map_struct, int32_t map_size)
+{
+    map_size = table_size(map_size);
+
+    return (size_t)map_size * map_struct->elem_size + map_size;
+}
+
+static array_hashmap_bool cuckoo_table_init(hashmap_t *map_struct, table_t *table,
+                                            int32_t map_size, char *map)
+{
+    double max_load = 0;
+
+    map_size = table_size(map_size);
+
+    table->map = map ? map : table_alloc(cuckoo_table_bytes(map_struct, map_size));
+    if (!table->map) {
+        return 0;
+    }
+
+    max_load = map_struct->max_load;
+    if (max_load > CUCKOO_MAX_LOAD) {
+        max_load = CUCKOO_MAX_LOAD;
+    }
+
+    table->ctrl = (uint8_t *)&table->map[(size_t)map_size * map_struct->elem_size];
+    table->map_size = map_size;
+    table->max_size = (map_size - BUCKET_SLOTS) * max_load;
+    table->now_in_map = 0;
+    table->deleted = 0;
+
+    memset(table->ctrl, ctrl_empty, map_size);
+
+    return 1;
+}
+
+static int32_t bucket_lookup(hashmap_t *map_struct, table_t *table, int32_t bucket,
+                             array_hashmap_hash hash, const void *key_data, cmp_t cmp,
+                             int32_t cmp_stat)
+{
+    uint64_t mask = 0;
+
+    int32_t index = 0;
+    slot_t *slot = NULL;
+
+    mask = group_match(group_load(table, bucket), hash_tag(hash));
+    while (mask) {
+        index = bucket * BUCKET_SLOTS + group_slot(mask);
+        slot = slot_i(table, index);
+        if (!slot_hash_differs(slot, hash) && stat_cmp(cmp_stat, cmp, key_data, elem_data(slot))) {
+            return index;
+        }
+
+        mask &= mask - 1;
+    }
+
+    return -1;
+}
+
+static int32_t cuckoo_lookup(hashmap_t *map_struct, table_t *table, array_hashmap_hash hash,
+                             const void *key_data, cmp_t cmp, int32_t cmp_stat)
+{
+    int32_t buckets[2];
+    int32_t index = 0;
+
+    bucket_pair(map_struct, table, hash, buckets);
+
+    index = bucket_lookup(map_struct, table, buckets[0], hash, key_data, cmp, cmp_stat);
+    if (index >= 0) {
+        return index;
+    }
+
+    if (buckets[1] != buckets[0]) {
+        index = bucket_lookup(map_struct, table, buckets[1], hash, key_data, cmp, cmp_stat);
+        if (index >= 0) {
+            return index;
+        }
+    }
+
+    return bucket_lookup(map_struct, table, stash_bucket(table), hash, key_data, cmp, cmp_stat);
+}
+
+static void slot_set(hashmap_t *map_struct, slot_t *slot, array_hashmap_hash add_hash,
+                     const void *add_elem_data, array_hashmap_time expire)
+{
+    if (is_store_hash()) {
+        slot->hash = add_hash;
+    }
+    if (is_ttl()) {
+        data_expire(elem_data(slot)) = expire;
+    }
+    memcpy(elem_data(slot), add_elem_data, map_struct->data_size);
+}
+
+static void slot_move(hashmap_t *map_struct, table_t *table, int32_t from, int32_t to)
+{
+    memcpy(slot_i(table, to), slot_i(table, from), map_struct->elem_size);
+    table->ctrl[to] = table->ctrl[from];
+    table->ctrl[from] = ctrl_empty;
+
+    stat_add(stat_displace, 1);
+}
+
+static array_hashmap_bool search_is_on_path(const search_node_t *nodes, int32_t node,
+                                            int32_t index)
+{
+    for (; nodes[node].parent >= 0; node = nodes[node].parent) {
+        if (nodes[nodes[node].parent].bucket * BUCKET_SLOTS + nodes[node].slot == index) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Breadth-first search for the shortest chain of elements that can each move to their other
+ * bucket, ending in a free slot. Nothing is moved before the chain is found, so a failed
+ * search leaves the table as it was. Returns the slot freed in one of the two buckets.
+ */
+static int32_t cuckoo_search(hashmap_t *map_struct, table_t *table, const int32_t *buckets)
+{
+    search_node_t nodes[CUCKOO_SEARCH];
+    int32_t head = 0;
+    int32_t tail = 0;
+    int32_t node = 0;
+    int32_t alt_buckets[2];
+    int32_t alt = 0;
+    uint64_t mask = 0;
+
+    int32_t from = 0;
+    int32_t to = 0;
+    int32_t i = 0;
+
+    nodes[tail].bucket = buckets[0];
+    nodes[tail].parent = -1;
+    nodes[tail++].slot = -1;
+    if (buckets[1] != buckets[0]) {
+        nodes[tail].bucket = buckets[1];
+        nodes[tail].parent = -1;
+        nodes[tail++].slot = -1;
+    }
+
+    for (head = 0; head < tail; head++) {
+        for (i = 0; i < BUCKET_SLOTS; i++) {
+            from = nodes[head].bucket * BUCKET_SLOTS + i;
+            if (search_is_on_path(nodes, head, from)) {
+                continue;
+            }
+
+            bucket_pair(map_struct, table, slot_hash(slot_i(table, from)), alt_buckets);
+            alt = alt_buckets[0] == nodes[head].bucket ? alt_buckets[1] : alt_buckets[0];
+            if (alt == nodes[head].bucket) {
+                continue;
+            }
+
+            mask = group_match_free(group_load(table, alt));
+            if (mask) {
+                stat_add(stat_free_search, 1);
+
+                to = alt * BUCKET_SLOTS + group_slot(mask);
+                for (node = head;; node = nodes[node].parent) {
+                    slot_move(map_struct, table, from, to);
+                    stat_add(stat_free_distance, 1);
+
+                    to = from;
+                    if (nodes[node].parent < 0) {
+                        return to;
+                    }
+                    from = nodes[nodes[node].parent].bucket * BUCKET_SLOTS + nodes[node].slot;
+                }
+            }
+
+            if (tail < CUCKOO_SEARCH) {
+                nodes[tail].bucket = alt;
+                nodes[tail].parent = head;
+                nodes[tail++].slot = i;
+            }
+        }
+    }
+
+    return -1;
+}
+
+static int32_t cuckoo_insert(hashmap_t *map_struct, table_t *table, array_hashmap_hash add_hash,
+                             const void *add_elem_data, array_hashmap_time expire)
+{
+    int32_t buckets[2];
+    uint64_t mask = 0;
+
+    int32_t index = -1;
+    int32_t i = 0;
+
+    bucket_pair(map_struct, table, add_hash, buckets);
+
+    for (i = 0; i < 2 && index < 0; i++) {
+        mask = group_match_free(group_load(table, buckets[i]));
+        if (mask) {
+            stat_add(stat_free_search, 1);
+            index = buckets[i] * BUCKET_SLOTS + group_slot(mask);
+        }
+    }
+
+    if (index < 0) {
+        index = cuckoo_search(map_struct, table, buckets);
+    }
+
+    if (index < 0) {
+        mask = group_match_free(group_load(table, stash_bucket(table)));
+        if (!mask) {
+            return -1;
+        }
+        index = stash_bucket(table) * BUCKET_SLOTS + group_slot(mask);
+    }
+
+    table->ctrl[index] = hash_tag(add_hash);
+    slot_set(map_struct, slot_i(table, index), add_hash, add_elem_data, expire);
+
+    table->now_in_map++;
+
+    return index;
+}
+
+static void cuckoo_erase(table_t *table, int32_t index)
+{
+    table->ctrl[index] = ctrl_empty;
+    table->now_in_map--;
+}
+
+static array_hashmap_ret_t cuckoo_add(hashmap_t *map_struct, shard_t *shard,
+                                      array_hashmap_hash add_hash, const void *add_elem_data,
+                                      void *res_elem_data, on_already_in_t on_already_in,
+                                      array_hashmap_time expire, void **hashmap_elem_data)
+{
+    table_t *table = NULL;
+    int32_t index = 0;
+    slot_t *slot = NULL;
+
+    table = &shard->table;
+
+    index = cuckoo_lookup(map_struct, table, add_hash, add_elem_data, map_struct->add_cmp,
+                          stat_add_cmp);
+    /* A key the migration could not move yet is still in the old array */
+    if (index < 0 && is_migrating(shard)) {
+        index = cuckoo_lookup(map_struct, &shard->old_table, add_hash, add_elem_data,
+                              map_struct->add_cmp, stat_add_cmp);
+        if (index >= 0) {
+            table = &shard->old_table;
+        }
+    }
+    if (index >= 0) {
+        slot = slot_i(table, index);
+        *hashmap_elem_data = elem_data(slot);
+        if (data_is_expired(elem_data(slot), time_now())) {
+            slot_set(map_struct, slot, add_hash, add_elem_data, expire);
+            return array_hashmap_elem_added;
+        }
+
+        hashmap_already_in(map_struct, elem_data(slot), add_elem_data, res_elem_data,
+                           on_already_in, expire);
+        return array_hashmap_elem_already_in;
+    }
+
+    if (all_in_map(shard) >= table->max_size) {
+        return array_hashmap_full;
+    }
+
+    index = cuckoo_insert(map_struct, table, add_hash, add_elem_data, expire);
+    if (index < 0) {
+        return array_hashmap_full;
+    }
+    *hashmap_elem_data = elem_data(slot_i(table, index));
+
+    return array_hashmap_elem_added;
+}
+
+static void *cuckoo_find(hashmap_t *map_struct, table_t *table, array_hashmap_hash find_hash,
+                         const void *find_elem_data)
+{
+    int32_t index = 0;
+
+    index = cuckoo_lookup(map_struct, table, find_hash, find_elem_data, map_struct->find_cmp,
+                          stat_find_cmp);
+    if (index < 0 || data_is_expired(elem_data(slot_i(table, index)), time_now())) {
+        return NULL;
+    }
+
+    return elem_data(slot_i(table, index));
+}
+
+static array_hashmap_ret_t cuckoo_del(hashmap_t *map_struct, table_t *table,
+                                      array_hashmap_hash del_hash, const void *del_elem_data,
+                                      void *res_elem_data)
+{
+    int32_t index = 0;
+
+    index = cuckoo_lookup(map_struct, table, del_hash, del_elem_data, map_struct->del_cmp,
+                          stat_del_cmp);
+    if (index < 0) {
+        return array_hashmap_elem_not_deled;
+    }
+
+    if (data_is_expired(elem_data(slot_i(table, index)), time_now())) {
+        cuckoo_erase(table, index);
+        return array_hashmap_elem_not_deled;
+    }
+
+    if (res_elem_data) {
+        memcpy(res_elem_data, elem_data(slot_i(table, index)), map_struct->data_size);
+    }
+
+    cuckoo_erase(table, index);
+
+    return array_hashmap_elem_deled;
+}
+
+static int32_t cuckoo_del_by_func(hashmap_t *map_struct, table_t *table, int32_t from,
+                                  int32_t to, del_func_t del_func)
+{
+    array_hashmap_time now = 0;
+    int32_t del_count = 0;
+    int32_t i = 0;
+
+    now = time_now();
+
+    for (i = from; i < to; i++) {
+        if (!is_full(table->ctrl[i])) {
+            continue;
+        }
+
+        if (data_is_del(elem_data(slot_i(table, i)), del_func, now)) {
+            cuckoo_erase(table, i);
+            del_count++;
+        }
+    }
+
+    return del_count;
+}
+
+static void cuckoo_del_mark(hashmap_t *map_struct, table_t *table, int32_t from, int32_t to,
+                            del_func_t del_func, uint8_t *marks)
+{
+    array_hashmap_time now = 0;
+    int32_t i = 0;
+
+    now = time_now();
+
+    for (i = from; i < to; i++) {
+        marks[i] = 0;
+
+        if (is_full(table->ctrl[i]) && data_is_del(elem_data(slot_i(table, i)), del_func, now)) {
+            marks[i] = mark_del;
+        }
+    }
+}
+
+static int32_t cuckoo_del_marked(hashmap_t *map_struct, table_t *table, int32_t from, int32_t to,
+                                 const uint8_t *marks)
+{
+    int32_t del_count = 0;
+    int32_t i = 0;
+
+    (void)map_struct;
+
+    for (i = from; i < to; i++) {
+        if (marks[i] & mark_del) {
+            cuckoo_erase(table, i);
+            del_count++;
+        }
+    }
+
+    return del_count;
+}
+
+static array_hashmap_bool cuckoo_foreach(hashmap_t *map_struct, table_t *table, int32_t *index,
+                                         int32_t end, array_hashmap_time now,
+                                         foreach_func_t foreach_func, void *arg, int32_t *visited)
+{
+    int32_t i = 0;
+
+    while (*index < end) {
+        i = (*index)++;
+
+        if (!is_full(table->ctrl[i]) || data_is_expired(elem_data(slot_i(table, i)), now)) {
+            continue;
+        }
+
+        (*visited)++;
+        if (foreach_func(elem_data(slot_i(table, i)), arg) == array_hashmap_foreach_stop) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static void cuckoo_prefetch(hashmap_t *map_struct, table_t *table, array_hashmap_hash hash,
+                            int32_t depth)
+{
+    int32_t buckets[2];
+    uint64_t mask = 0;
+    int32_t i = 0;
+
+    bucket_pair(map_struct, table, hash, buckets);
+
+    for (i = 0; i < 2; i++) {
+        if (!depth) {
+            __builtin_prefetch(&table->ctrl[buckets[i] * BUCKET_SLOTS]);
+            __builtin_prefetch(slot_i(table, buckets[i] * BUCKET_SLOTS));
+            continue;
+        }
+
+        mask = group_match(group_load(table, buckets[i]), hash_tag(hash));
+        if (mask) {
+            __builtin_prefetch(slot_i(table, buckets[i] * BUCKET_SLOTS + group_slot(mask)));
+        }
+    }
+}
+
+static array_hashmap_bool cuckoo_migrate(hashmap_t *map_struct, shard_t *shard, int32_t index)
+{
+    table_t *old_table = NULL;
+    slot_t *slot = NULL;
+
+    old_table = &shard->old_table;
+
+    if (!is_full(old_table->ctrl[index])) {
+        return 1;
+    }
+
+    /* An element the new array can not take stays in the old one until a delete makes room */
+    slot = slot_i(old_table, index);
+    if (!data_is_expired(elem_data(slot), time_now()) &&
+        cuckoo_insert(map_struct, &shard->table, slot_hash(slot), elem_data(slot),
+                      is_ttl() ? data_expire(elem_data(slot)) : array_hashmap_no_expire) < 0) {
+        return 0;
+    }
+
+    cuckoo_erase(old_table, index);
+
+    return 1;
+}
+
+static void cuckoo_migrate_key(hashmap_t *map_struct, shard_t *shard, array_hashmap_hash hash,
+                               const void *key_data, cmp_t cmp, int32_t cmp_stat)
+{
+    int32_t index = 0;
+
+    index = cuckoo_lookup(map_struct, &shard->old_table, hash, key_data, cmp, cmp_stat);
+    if (index >= 0) {
+        cuckoo_migrate(map_struct, shard, index);
+    }
+}
+
+static void cuckoo_stats(hashmap_t *map_struct, table_t *table, array_hashmap_stats_t *stats)
+{
+    int32_t buckets[2];
+    int32_t probe = 0;
+    int32_t i = 0;
+
+    for (i = 0; i < table->map_size; i++) {
+        if (!is_full(table->ctrl[i])) {
+            continue;
+        }
+
+        bucket_pair(map_struct, table, slot_hash(slot_i(table, i)), buckets);
+        if (i / BUCKET_SLOTS == buckets[0]) {
+            probe = 0;
+        } else if (i / BUCKET_SLOTS == buckets[1]) {
+            probe = 1;
+        } else {
+            probe = 2;
+        }
+
+        if (probe) {
+            stats->non_owner_count++;
+        }
+
+        stats_chain_add(stats, probe + 1);
+    }
+}
+
+const engine_t cuckoo_engine = { 0,                 cuckoo_table_init,  cuckoo_table_bytes,
+                                 cuckoo_add,        cuckoo_find,        NULL,
+                                 cuckoo_del,        cuckoo_del_by_func, cuckoo_del_mark,
+                                 cuckoo_del_marked, cuckoo_foreach,     cuckoo_prefetch,
+                                 cuckoo_migrate,    cuckoo_migrate_key, cuckoo_stats };
@@ -0,0 +1,296 @@
+#include "array_hashmap_internal.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/random.h>
+#include <time.h>
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#elif defined(__aarch64__) && defined(__linux__)
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#endif
+
+#define WY_P0 UINT64_C(0xa0761d6478bd642f)
+#define WY_P1 UINT64_C(0xe7037ed1a0b428db)
+#define WY_P2 UINT64_C(0x8ebc6af09c88c6e3)
+#define WY_P3 UINT64_C(0x589965cc75374cc3)
+
+#define CRC32C_POLY 0x82f63b78
+
+static uint64_t read64(const uint8_t *bytes)
+{
+    uint64_t word = 0;
+
+    memcpy(&word, bytes, sizeof(word));
+    return word;
+}
+
+static uint64_t read32(const uint8_t *bytes)
+{
+    uint32_t word = 0;
+
+    memcpy(&word, bytes, sizeof(word));
+    return word;
+}
+
+static void wy_mul(uint64_t *a, uint64_t *b)
+{
+#ifdef __SIZEOF_INT128__
+    __extension__ unsigned __int128 product = 0;
+
+    product = *a;
+    product *= *b;
+    *a = (uint64_t)product;
+    *b = (uint64_t)(product >> 64);
+#else
+    uint64_t ha = *a >> 32;
+    uint64_t hb = *b >> 32;
+    uint64_t la = (uint32_t)*a;
+    uint64_t lb = (uint32_t)*b;
+    uint64_t rh = ha * hb;
+    uint64_t rm0 = ha * lb;
+    uint64_t rm1 = hb * la;
+    uint64_t rl = la * lb;
+    uint64_t t = rl + (rm0 << 32);
+    uint64_t lo = t + (rm1 << 32);
+
+    *b = rh + (rm0 >> 32) + (rm1 >> 32) + (t < rl) + (lo < t);
+    *a = lo;
+#endif
+}
+
+static uint64_t wy_mix(uint64_t a, uint64_t b)
+{
+    wy_mul(&a, &b);
+    return a ^ b;
+}
+
+/* wyhash final version 4: 48 bytes per round in three independent lanes */
+static array_hashmap_hash hash_wy(uint64_t seed, const void *data, size_t len)
+{
+    const uint8_t *bytes = data;
+    uint64_t see1 = 0;
+    uint64_t see2 = 0;
+    uint64_t a = 0;
+    uint64_t b = 0;
+    size_t i = 0;
+
+    seed ^= wy_mix(seed ^ WY_P0, WY_P1);
+
+    if (len <= 16) {
+        if (len >= 4) {
+            a = (read32(bytes) << 32) | read32(bytes + ((len >> 3) << 2));
+            b = (read32(bytes + len - 4) << 32) | read32(bytes + len - 4 - ((len >> 3) << 2));
+        } else if (len > 0) {
+            a = ((uint64_t)bytes[0] << 16) | ((uint64_t)bytes[len >> 1] << 8) | bytes[len - 1];
+        }
+    } else {
+        i = len;
+        if (i > 48) {
+            see1 = seed;
+            see2 = seed;
+            do {
+                seed = wy_mix(read64(bytes) ^ WY_P1, read64(bytes + 8) ^ seed);
+                see1 = wy_mix(read64(bytes + 16) ^ WY_P2, read64(bytes + 24) ^ see1);
+                see2 = wy_mix(read64(bytes + 32) ^ WY_P3, read64(bytes + 40) ^ see2);
+                bytes += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = wy_mix(read64(bytes) ^ WY_P1, read64(bytes + 8) ^ seed);
+            bytes += 16;
+            i -= 16;
+        }
+        a = read64(bytes + i - 16);
+        b = read64(bytes + i - 8);
+    }
+
+    a ^= WY_P1;
+    b ^= seed;
+    wy_mul(&a, &b);
+    a = wy_mix(a ^ WY_P0 ^ len, b ^ WY_P1);
+
+    return (array_hashmap_hash)(a ^ (a >> 32));
+}
+
+static uint32_t crc32c_byte(uint32_t crc, uint8_t byte)
+{
+    int32_t i = 0;
+
+    crc ^= byte;
+    for (i = 0; i < 8; i++) {
+        crc = (crc >> 1) ^ (CRC32C_POLY & -(crc & 1));
+    }
+
+    return crc;
+}
+
+/* CRC is linear, so the seed is also multiplied in after it to make the cells differ per map */
+static array_hashmap_hash crc32c_final(uint64_t seed, uint32_t crc)
+{
+    uint64_t mix = 0;
+
+    mix = wy_mix(crc ^ WY_P0, seed ^ WY_P1);
+
+    return (array_hashmap_hash)(mix ^ (mix >> 32));
+}
+
+/* The seed is the initial value and the first 4 bytes, so every path gives the same hash */
+static array_hashmap_hash hash_crc32c_soft(uint64_t seed, const void *data, size_t len)
+{
+    const uint8_t *bytes = data;
+    uint32_t crc = 0;
+    int32_t i = 0;
+
+    crc = (uint32_t)seed;
+    for (i = 32; i < 64; i += 8) {
+        crc = crc32c_byte(crc, (uint8_t)(seed >> i));
+    }
+
+    while (len--) {
+        crc = crc32c_byte(crc, *bytes++);
+    }
+
+    return crc32c_final(seed, crc);
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2"))) static array_hashmap_hash
+hash_crc32c_hw(uint64_t seed, const void *data, size_t len)
+{
+    const uint8_t *bytes = data;
+    uint64_t crc = 0;
+
+    crc = _mm_crc32_u32((uint32_t)seed, (uint32_t)(seed >> 32));
+
+    while (len >= sizeof(uint64_t)) {
+        crc = _mm_crc32_u64(crc, read64(bytes));
+        bytes += sizeof(uint64_t);
+        len -= sizeof(uint64_t);
+    }
+
+    while (len--) {
+        crc = _mm_crc32_u8((uint32_t)crc, *bytes++);
+    }
+
+    return crc32c_final(seed, (uint32_t)crc);
+}
+#elif defined(__aarch64__) && defined(__linux__)
+__attribute__((target("+crc"))) static array_hashmap_hash
+hash_crc32c_hw(uint64_t seed, const void *data, size_t len)
+{
+    const uint8_t *bytes = data;
+    uint32_t crc = 0;
+
+    crc = __crc32cw((uint32_t)seed, (uint32_t)(seed >> 32));
+
+    while (len >= sizeof(uint64_t)) {
+        crc = __crc32cd(crc, read64(bytes));
+        bytes += sizeof(uint64_t);
+        len -= sizeof(uint64_t);
+    }
+
+    while (len--) {
+        crc = __crc32cb(crc, *bytes++);
+    }
+
+    return crc32c_final(seed, crc);
+}
+#endif
+
+hash_bytes_t hash_select(array_hashmap_hash_func_t hash_func)
+{
+    if (hash_func != array_hashmap_hash_crc32c) {
+        return hash_wy;
+    }
+
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("sse4.2")) {
+        return hash_crc32c_hw;
+    }
+#elif defined(__aarch64__) && defined(__linux__)
+    if (getauxval(AT_HWCAP) & HWCAP_CRC32) {
+        return hash_crc32c_hw;
+    }
+#endif
+
+    return hash_crc32c_soft;
+}
+
+uint64_t hash_seed(const void *salt)
+{
+    uint64_t seed = 0;
+    struct timespec now;
+
+    if (getrandom(&seed, sizeof(seed), GRND_NONBLOCK) != sizeof(seed)) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        seed = hash_wy((uint64_t)now.tv_sec * 1000000000 + now.tv_nsec, &salt, sizeof(salt));
+        seed = seed << 32 | hash_wy(seed, &now, sizeof(now));
+    }
+
+    /* Zero asks for a random seed, so it is never the result */
+    return seed ? seed : 1;
+}
+
+array_hashmap_hash array_hashmap_hash_bytes(array_hashmap_t map_struct_c, const void *data,
+                                            size_t len)
+{
+    hashmap_t *map_struct = NULL;
+    map_struct = (hashmap_t *)map_struct_c;
+    if (!map_struct || (!data && len)) {
+        return 0;
+    }
+
+    return map_struct->hash_bytes(map_struct->seed, data, len);
+}
+
+array_hashmap_hash array_hashmap_hash_str(array_hashmap_t map_struct_c, const char *str)
+{
+    hashmap_t *map_struct = NULL;
+    map_struct = (hashmap_t *)map_struct_c;
+    if (!map_struct || !str) {
+        return 0;
+    }
+
+    return map_struct->hash_bytes(map_struct->seed, str, strlen(str));
+}
+
+array_hashmap_hash array_hashmap_hash_seed(array_hashmap_hash_func_t hash_func, uint64_t seed,
+                                           const void *data, size_t len)
+{
+    if (!data && len) {
+        return 0;
+    }
+
+    return hash_select(hash_func)(seed, data, len);
+}
+
+array_hashmap_hash key_func_hash(hashmap_t *map_struct, const void *key_data)
+{
+    const char *key = NULL;
+
+    if (map_struct->key_size > 0) {
+        return map_struct->hash_bytes(map_struct->seed, key_data, map_struct->key_size);
+    }
+
+    /* The pointer may be unaligned in a packed element */
+    memcpy(&key, key_data, sizeof(key));
+    return map_struct->hash_bytes(map_struct->seed, key, strlen(key));
+}
+
+array_hashmap_bool key_func_cmp(hashmap_t *map_struct, const void *key_data,
+                                const void *hashmap_elem_data)
+{
+    const char *key1 = NULL;
+    const char *key2 = NULL;
+
+    if (map_struct->key_size > 0) {
+        return !memcmp(key_data, hashmap_elem_data, map_struct->key_size);
+    }
+
+    memcpy(&key1, key_data, sizeof(key1));
+    memcpy(&key2, hashmap_elem_data, sizeof(key2));
+    return !strcmp(key1, key2);
+}
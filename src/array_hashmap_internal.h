@@ -0,0 +1,260 @@
+#ifndef __ARRAY_HASHMAP_INTERNAL__
+#define __ARRAY_HASHMAP_INTERNAL__
+
+#include "array_hashmap.h"
+#include <stddef.h>
+#ifdef LATENCY_STATS
+#include <time.h>
+#endif
+#ifdef THREAD_SAFETY
+#include <pthread.h>
+#endif
+
+typedef struct table {
+    char *map;
+    uint8_t *ctrl;
+    int32_t map_size;
+    int32_t max_size;
+    int32_t now_in_map;
+    int32_t deleted;
+} table_t;
+
+typedef struct __attribute__((packed)) expire {
+    array_hashmap_time time;
+} expire_t;
+
+typedef struct retired {
+    char *map;
+    int32_t map_size;
+    struct retired *next;
+} retired_t;
+
+typedef struct arena_block {
+    struct arena_block *next;
+    size_t size;
+    size_t used;
+} arena_block_t;
+
+typedef struct __attribute__((aligned(64))) shard {
+    table_t table;
+    table_t old_table;
+    int32_t migrate_index;
+    array_hashmap_bool migrate_blocked;
+    int32_t expire_index;
+    retired_t *retired;
+    arena_block_t *arena;
+#ifdef THREAD_SAFETY
+    uint32_t seq;
+    pthread_rwlock_t rwlock;
+#endif
+} shard_t;
+
+#ifdef LATENCY_STATS
+typedef struct latency_block {
+#ifdef THREAD_SAFETY
+    pthread_t owner;
+#endif
+    struct latency_block *next;
+    uint64_t buckets[array_hashmap_latency_ops][array_hashmap_latency_buckets];
+} latency_block_t;
+#endif
+
+struct engine;
+
+typedef array_hashmap_hash (*hash_bytes_t)(uint64_t seed, const void *data, size_t len);
+
+enum stat_id {
+    stat_add_cmp,
+    stat_find_cmp,
+    stat_del_cmp,
+    stat_displace,
+    stat_free_search,
+    stat_free_distance,
+    stat_count
+};
+
+typedef struct hashmap {
+    shard_t *shards;
+    int32_t shard_count;
+    int32_t shard_bits;
+    int32_t migrate_step;
+    int32_t min_map_size;
+    int32_t flags;
+    double max_load;
+    const struct engine *engine;
+    int32_t elem_size;
+    int32_t data_size;
+    int32_t data_offset;
+    int32_t data_stride;
+    add_hash_t add_hash;
+    add_cmp_t add_cmp;
+    find_hash_t find_hash;
+    find_cmp_t find_cmp;
+    del_hash_t del_hash;
+    del_cmp_t del_cmp;
+    array_hashmap_hash_func_t hash_func;
+    uint64_t seed;
+    hash_bytes_t hash_bytes;
+    int32_t key_size;
+    time_func_t time_func;
+    alloc_func_t alloc_func;
+    free_func_t free_func;
+    void *alloc_arg;
+    uint64_t stats[stat_count];
+#ifdef LATENCY_STATS
+    latency_block_t *latency;
+    uint64_t latency_id;
+    uint64_t latency_ticks;
+    uint64_t latency_ns;
+#endif
+    char *mapped;
+    size_t mapped_size;
+    array_hashmap_bool is_shared;
+    array_hashmap_bool is_thread_safety;
+} hashmap_t;
+
+typedef array_hashmap_bool (*cmp_t)(const void *elem_data, const void *hashmap_elem_data);
+
+typedef struct engine {
+    int32_t header_size;
+    array_hashmap_bool (*table_init)(hashmap_t *map_struct, table_t *table, int32_t map_size,
+                                     char *map);
+    size_t (*table_bytes)(hashmap_t *map_struct, int32_t map_size);
+    array_hashmap_ret_t (*add)(hashmap_t *map_struct, shard_t *shard, array_hashmap_hash add_hash,
+                               const void *add_elem_data, void *res_elem_data,
+                               on_already_in_t on_already_in, array_hashmap_time expire,
+                               void **hashmap_elem_data);
+    void *(*find)(hashmap_t *map_struct, table_t *table, array_hashmap_hash find_hash,
+                  const void *find_elem_data);
+    array_hashmap_ret_t (*find_once)(hashmap_t *map_struct, table_t *table,
+                                     array_hashmap_hash find_hash, const void *find_elem_data,
+                                     void *res_elem_data);
+    array_hashmap_ret_t (*del)(hashmap_t *map_struct, table_t *table, array_hashmap_hash del_hash,
+                               const void *del_elem_data, void *res_elem_data);
+    int32_t (*del_by_func)(hashmap_t *map_struct, table_t *table, int32_t from, int32_t to,
+                           del_func_t del_func);
+    void (*del_mark)(hashmap_t *map_struct, table_t *table, int32_t from, int32_t to,
+                     del_func_t del_func, uint8_t *marks);
+    int32_t (*del_marked)(hashmap_t *map_struct, table_t *table, int32_t from, int32_t to,
+                          const uint8_t *marks);
+    array_hashmap_bool (*foreach)(hashmap_t *map_struct, table_t *table, int32_t *index,
+                                  int32_t end, array_hashmap_time now, foreach_func_t foreach_func,
+                                  void *arg, int32_t *visited);
+    void (*prefetch)(hashmap_t *map_struct, table_t *table, array_hashmap_hash hash,
+                     int32_t depth);
+    array_hashmap_bool (*migrate)(hashmap_t *map_struct, shard_t *shard, int32_t index);
+    void (*migrate_key)(hashmap_t *map_struct, shard_t *shard, array_hashmap_hash hash,
+                        const void *elem_data, cmp_t cmp, int32_t cmp_stat);
+    void (*stats)(hashmap_t *map_struct, table_t *table, array_hashmap_stats_t *stats);
+} engine_t;
+
+extern const engine_t chain_engine;
+extern const engine_t swiss_engine;
+extern const engine_t cuckoo_engine;
+
+static __inline__ array_hashmap_hash hash_mix(array_hashmap_hash hash)
+{
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6b;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35;
+    hash ^= hash >> 16;
+
+    return hash;
+}
+
+static __inline__ void stats_chain_add(array_hashmap_stats_t *stats, int32_t length)
+{
+    stats->chain_count++;
+    stats->chain_hist[length < array_hashmap_stats_hist_size ? length
+                                                             : array_hashmap_stats_hist_size - 1]++;
+    if (length > stats->chain_max) {
+        stats->chain_max = length;
+    }
+    stats->chain_avg += length;
+}
+
+#ifdef LATENCY_STATS
+static __inline__ uint64_t latency_ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+#endif
+}
+
+void latency_init(hashmap_t *map_struct);
+void latency_free(hashmap_t *map_struct);
+void latency_add(hashmap_t *map_struct, int32_t op, uint64_t ticks);
+
+#define latency_start(start) ((start) = latency_ticks())
+#define latency_end(op, start) latency_add(map_struct, (op), latency_ticks() - (start))
+#else
+#define latency_start(start) ((void)0)
+#define latency_end(op, start) ((void)0)
+#endif
+
+hash_bytes_t hash_select(array_hashmap_hash_func_t hash_func);
+uint64_t hash_seed(const void *salt);
+array_hashmap_hash key_func_hash(hashmap_t *map_struct, const void *key_data);
+array_hashmap_bool key_func_cmp(hashmap_t *map_struct, const void *key_data,
+                                const void *hashmap_elem_data);
+
+array_hashmap_hash str_hash(const void *elem_data);
+array_hashmap_bool str_cmp(const void *elem_data, const void *hashmap_elem_data);
+array_hashmap_bool str_reserve(hashmap_t *map_struct, shard_t *shard, const void *elem_data);
+void str_store(shard_t *shard, void *hashmap_elem_data);
+void str_compact(hashmap_t *map_struct, shard_t *shard);
+void str_free(shard_t *shard);
+
+void hashmap_already_in(hashmap_t *map_struct, void *hashmap_elem_data, const void *add_elem_data,
+                        void *res_elem_data, on_already_in_t on_already_in,
+                        array_hashmap_time expire);
+
+enum mark { mark_del = 0x1, mark_head = 0x2 };
+
+#define optimistic_retry ((array_hashmap_ret_t) - 4)
+
+#define index_hash(table, hash)                                                            \
+    ((int32_t)(((uint64_t)(uint32_t)((hash) << map_struct->shard_bits) * (table)->map_size) >> \
+               32))
+#define table_alloc(size) map_struct->alloc_func((size), map_struct->alloc_arg)
+#define is_key_func() (map_struct->key_size != 0)
+#define is_func_set(hash, cmp) (is_key_func() || (map_struct->hash && map_struct->cmp))
+#define func_hash(hash, data) \
+    hash_mix(is_key_func() ? key_func_hash(map_struct, (data)) : map_struct->hash(data))
+#define elem_add_hash(data) func_hash(add_hash, data)
+#define elem_data(elem) ((char *)(elem) + map_struct->data_offset)
+#define is_store_hash() (map_struct->flags & array_hashmap_opt_store_hash)
+#define is_split_data() (map_struct->flags & array_hashmap_opt_split_data)
+#define is_str_key() (map_struct->flags & array_hashmap_opt_str_key)
+
+#define is_ttl() (map_struct->flags & array_hashmap_opt_ttl)
+#define time_now() (is_ttl() ? map_struct->time_func() : 0)
+#define data_expire(data) (((expire_t *)(data)) - 1)->time
+#define data_is_expired(data, now) (is_ttl() && data_expire(data) <= (now))
+#define data_is_del(data, del_func, now) \
+    (data_is_expired(data, now) || ((del_func) && (del_func)(data)))
+
+#define is_stats() (map_struct->flags & array_hashmap_opt_stats)
+#ifdef THREAD_SAFETY
+#define stat_add(stat, count)                                                                   \
+    (is_stats() ? (void)__atomic_fetch_add(&map_struct->stats[stat], (count), __ATOMIC_RELAXED) \
+                : (void)0)
+#else
+#define stat_add(stat, count) (is_stats() ? (void)(map_struct->stats[stat] += (count)) : (void)0)
+#endif
+#define stat_cmp(stat, cmp, elem_data, hashmap_elem_data)                                       \
+    (stat_add(stat, 1), is_key_func() ? key_func_cmp(map_struct, elem_data, hashmap_elem_data) \
+                                      : (cmp)(elem_data, hashmap_elem_data))
+
+#define read_once(x) (*(volatile __typeof__(x) *)&(x))
+
+#define is_migrating(shard) ((shard)->old_table.map != NULL)
+#define all_in_map(shard) ((shard)->table.now_in_map + (shard)->old_table.now_in_map)
+
+#endif
@@ -0,0 +1,243 @@
+#include "array_hashmap_internal.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define LATENCY_SUB_BUCKETS (1 << array_hashmap_latency_sub_bits)
+
+static uint64_t latency_bucket_min(int32_t bucket)
+{
+    int32_t msb = 0;
+
+    if (bucket < LATENCY_SUB_BUCKETS) {
+        return bucket;
+    }
+
+    msb = (bucket >> array_hashmap_latency_sub_bits) + array_hashmap_latency_sub_bits - 1;
+
+    return (uint64_t)(LATENCY_SUB_BUCKETS | (bucket & (LATENCY_SUB_BUCKETS - 1)))
+           << (msb - array_hashmap_latency_sub_bits);
+}
+
+static uint64_t latency_bucket_max(int32_t bucket)
+{
+    return latency_bucket_min(bucket + 1) - 1;
+}
+
+#ifdef LATENCY_STATS
+static int32_t latency_bucket(uint64_t ticks)
+{
+    int32_t msb = 0;
+
+    if (ticks < LATENCY_SUB_BUCKETS) {
+        return (int32_t)ticks;
+    }
+
+    msb = 63 - __builtin_clzll(ticks);
+
+    return ((msb - array_hashmap_latency_sub_bits + 1) << array_hashmap_latency_sub_bits) |
+           (int32_t)((ticks >> (msb - array_hashmap_latency_sub_bits)) &
+                     (LATENCY_SUB_BUCKETS - 1));
+}
+
+static uint64_t latency_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static uint64_t latency_next_id = 1;
+
+#ifdef THREAD_SAFETY
+static __thread uint64_t latency_cache_id;
+static __thread latency_block_t *latency_cache_block;
+#endif
+
+void latency_init(hashmap_t *map_struct)
+{
+    map_struct->latency = NULL;
+    map_struct->latency_id = __atomic_fetch_add(&latency_next_id, 1, __ATOMIC_RELAXED);
+    map_struct->latency_ticks = latency_ticks();
+    map_struct->latency_ns = latency_ns();
+}
+
+void latency_free(hashmap_t *map_struct)
+{
+    latency_block_t *block = NULL;
+
+    while (map_struct->latency) {
+        block = map_struct->latency;
+        map_struct->latency = block->next;
+        free(block);
+    }
+}
+
+static latency_block_t *latency_block(hashmap_t *map_struct)
+{
+    latency_block_t *block = NULL;
+#ifdef THREAD_SAFETY
+    pthread_t self;
+
+    self = pthread_self();
+
+    block = __atomic_load_n(&map_struct->latency, __ATOMIC_ACQUIRE);
+    for (; block; block = block->next) {
+        if (pthread_equal(block->owner, self)) {
+            return block;
+        }
+    }
+
+    block = calloc(1, sizeof(latency_block_t));
+    if (!block) {
+        return NULL;
+    }
+
+    block->owner = self;
+    block->next = __atomic_load_n(&map_struct->latency, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&map_struct->latency, &block->next, block, 1,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
+#else
+    block = map_struct->latency;
+    if (!block) {
+        block = calloc(1, sizeof(latency_block_t));
+        map_struct->latency = block;
+    }
+#endif
+
+    return block;
+}
+
+void latency_add(hashmap_t *map_struct, int32_t op, uint64_t ticks)
+{
+    latency_block_t *block = NULL;
+    uint64_t *bucket = NULL;
+
+#ifdef THREAD_SAFETY
+    if (latency_cache_id == map_struct->latency_id) {
+        block = latency_cache_block;
+    } else {
+        block = latency_block(map_struct);
+        if (!block) {
+            return;
+        }
+
+        latency_cache_id = map_struct->latency_id;
+        latency_cache_block = block;
+    }
+#else
+    block = latency_block(map_struct);
+    if (!block) {
+        return;
+    }
+#endif
+
+    bucket = &block->buckets[op][latency_bucket(ticks)];
+    __atomic_store_n(bucket, *bucket + 1, __ATOMIC_RELAXED);
+}
+#endif
+
+array_hashmap_bool array_hashmap_get_latency(array_hashmap_t map_struct_c,
+                                             array_hashmap_latency_t *latency)
+{
+#ifdef LATENCY_STATS
+    latency_block_t *block = NULL;
+    uint64_t ticks = 0;
+    int32_t op = 0;
+    int32_t i = 0;
+#endif
+
+    hashmap_t *map_struct = NULL;
+    map_struct = (hashmap_t *)map_struct_c;
+    if (!map_struct || !latency) {
+        return array_hashmap_empty_args;
+    }
+
+    memset(latency, 0, sizeof(*latency));
+
+#ifdef LATENCY_STATS
+    ticks = latency_ticks() - map_struct->latency_ticks;
+    latency->ns_per_tick = ticks ? (double)(latency_ns() - map_struct->latency_ns) / ticks : 1.0;
+
+    block = __atomic_load_n(&map_struct->latency, __ATOMIC_ACQUIRE);
+    for (; block; block = block->next) {
+        for (op = 0; op < array_hashmap_latency_ops; op++) {
+            for (i = 0; i < array_hashmap_latency_buckets; i++) {
+                latency->buckets[op][i] += __atomic_load_n(&block->buckets[op][i],
+                                                           __ATOMIC_RELAXED);
+            }
+        }
+    }
+
+    for (op = 0; op < array_hashmap_latency_ops; op++) {
+        for (i = 0; i < array_hashmap_latency_buckets; i++) {
+            latency->count[op] += latency->buckets[op][i];
+        }
+    }
+
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+void array_hashmap_latency_merge(array_hashmap_latency_t *to, const array_hashmap_latency_t *from)
+{
+    int32_t op = 0;
+    int32_t i = 0;
+
+    if (!to || !from) {
+        return;
+    }
+
+    if (!to->ns_per_tick) {
+        to->ns_per_tick = from->ns_per_tick;
+    }
+
+    for (op = 0; op < array_hashmap_latency_ops; op++) {
+        to->count[op] += from->count[op];
+        for (i = 0; i < array_hashmap_latency_buckets; i++) {
+            to->buckets[op][i] += from->buckets[op][i];
+        }
+    }
+}
+
+uint64_t array_hashmap_latency_percentile(const array_hashmap_latency_t *latency,
+                                          array_hashmap_latency_op_t op, double percentile)
+{
+    uint64_t rank = 0;
+    uint64_t seen = 0;
+    int32_t i = 0;
+
+    if (!latency || (int32_t)op < 0 || op >= array_hashmap_latency_ops || !latency->count[op]) {
+        return 0;
+    }
+
+    if (percentile < 0) {
+        percentile = 0;
+    }
+
+    if (percentile > 100) {
+        percentile = 100;
+    }
+
+    rank = (uint64_t)(latency->count[op] * percentile / 100);
+    if (rank < latency->count[op] * percentile / 100 || rank == 0) {
+        rank++;
+    }
+
+    for (i = 0; i < array_hashmap_latency_buckets; i++) {
+        seen += latency->buckets[op][i];
+        if (seen >= rank) {
+            break;
+        }
+    }
+
+    if (i >= array_hashmap_latency_buckets - 1) {
+        return UINT64_MAX;
+    }
+
+    return (uint64_t)(latency_bucket_max(i) * latency->ns_per_tick);
+}
@@ -0,0 +1,233 @@
+#include "array_hashmap_internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_BLOCK_MIN 4096
+
+#define str_is_inline(str) ((str)->len <= array_hashmap_str_inline_size)
+#define arena_data(block) ((char *)((block) + 1))
+
+void array_hashmap_str_set(array_hashmap_t map_struct_c, array_hashmap_str_t *str, const char *key,
+                           uint32_t len)
+{
+    hashmap_t *map_struct = NULL;
+    map_struct = (hashmap_t *)map_struct_c;
+    if (!map_struct || !str || !key) {
+        return;
+    }
+
+    str->hash = map_struct->hash_bytes(map_struct->seed, key, len);
+    str->len = len;
+
+    if (str_is_inline(str)) {
+        memcpy(str->key.data, key, len);
+    } else {
+        str->key.ptr = key;
+    }
+}
+
+const char *array_hashmap_str_key(const array_hashmap_str_t *str)
+{
+    if (!str) {
+        return NULL;
+    }
+
+    return str_is_inline(str) ? str->key.data : str->key.ptr;
+}
+
+array_hashmap_hash str_hash(const void *elem_data)
+{
+    const array_hashmap_str_t *str = elem_data;
+
+    return str->hash;
+}
+
+array_hashmap_bool str_cmp(const void *elem_data, const void *hashmap_elem_data)
+{
+    const array_hashmap_str_t *str1 = elem_data;
+    const array_hashmap_str_t *str2 = hashmap_elem_data;
+
+    if (str1->hash != str2->hash || str1->len != str2->len) {
+        return 0;
+    }
+
+    return !memcmp(array_hashmap_str_key(str1), array_hashmap_str_key(str2), str1->len);
+}
+
+static arena_block_t *arena_block_new(size_t size)
+{
+    arena_block_t *block = NULL;
+
+    block = malloc(sizeof(arena_block_t) + size);
+    if (!block) {
+        return NULL;
+    }
+
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+
+    return block;
+}
+
+static void arena_free(arena_block_t *block)
+{
+    arena_block_t *next = NULL;
+
+    while (block) {
+        next = block->next;
+        free(block);
+        block = next;
+    }
+}
+
+static size_t arena_used(shard_t *shard)
+{
+    arena_block_t *block = NULL;
+    size_t used = 0;
+
+    for (block = shard->arena; block; block = block->next) {
+        used += block->used;
+    }
+
+    return used;
+}
+
+static array_hashmap_bool str_live_func(const void *elem_data, void *arg)
+{
+    const array_hashmap_str_t *str = elem_data;
+
+    if (!str_is_inline(str)) {
+        *(size_t *)arg += str->len;
+    }
+
+    return array_hashmap_foreach_continue;
+}
+
+static array_hashmap_bool str_copy_func(const void *elem_data, void *arg)
+{
+    array_hashmap_str_t *str = (array_hashmap_str_t *)elem_data;
+    arena_block_t *block = arg;
+    char *key = NULL;
+
+    if (!str_is_inline(str)) {
+        key = arena_data(block) + block->used;
+        memcpy(key, str->key.ptr, str->len);
+        block->used += str->len;
+        str->key.ptr = key;
+    }
+
+    return array_hashmap_foreach_continue;
+}
+
+/* Expired elements are still compared before they are dropped, so they are walked too */
+static void str_walk(hashmap_t *map_struct, shard_t *shard, foreach_func_t func, void *arg)
+{
+    int32_t index = 0;
+    int32_t visited = 0;
+
+    map_struct->engine->foreach(map_struct, &shard->table, &index, shard->table.map_size,
+                                INT64_MIN, func, arg, &visited);
+
+    if (is_migrating(shard)) {
+        index = 0;
+        map_struct->engine->foreach(map_struct, &shard->old_table, &index,
+                                    shard->old_table.map_size, INT64_MIN, func, arg, &visited);
+    }
+}
+
+static size_t arena_live(hashmap_t *map_struct, shard_t *shard)
+{
+    size_t live = 0;
+
+    str_walk(map_struct, shard, str_live_func, &live);
+
+    return live;
+}
+
+static array_hashmap_bool arena_compact(hashmap_t *map_struct, shard_t *shard, size_t size)
+{
+    arena_block_t *block = NULL;
+
+    if (size) {
+        block = arena_block_new(size);
+        if (!block) {
+            return 0;
+        }
+
+        str_walk(map_struct, shard, str_copy_func, block);
+    }
+
+    arena_free(shard->arena);
+    shard->arena = block;
+
+    return 1;
+}
+
+array_hashmap_bool str_reserve(hashmap_t *map_struct, shard_t *shard, const void *elem_data)
+{
+    const array_hashmap_str_t *str = elem_data;
+    arena_block_t *block = NULL;
+    size_t used = 0;
+    size_t live = 0;
+    size_t size = 0;
+
+    if (str_is_inline(str)) {
+        return 1;
+    }
+
+    if (shard->arena && shard->arena->size - shard->arena->used >= str->len) {
+        return 1;
+    }
+
+    used = arena_used(shard);
+    if (used) {
+        live = arena_live(map_struct, shard);
+    }
+
+    /* Compact when at least half of the arena is dead, else double it */
+    if (live * 2 <= used) {
+        size = (live + str->len) * 2;
+        return arena_compact(map_struct, shard, size > ARENA_BLOCK_MIN ? size : ARENA_BLOCK_MIN);
+    }
+
+    size = used + str->len;
+    block = arena_block_new(size > ARENA_BLOCK_MIN ? size : ARENA_BLOCK_MIN);
+    if (!block) {
+        return 0;
+    }
+
+    block->next = shard->arena;
+    shard->arena = block;
+
+    return 1;
+}
+
+void str_store(shard_t *shard, void *hashmap_elem_data)
+{
+    str_copy_func(hashmap_elem_data, shard->arena);
+}
+
+void str_compact(hashmap_t *map_struct, shard_t *shard)
+{
+    size_t used = 0;
+    size_t live = 0;
+
+    used = arena_used(shard);
+    if (!used) {
+        return;
+    }
+
+    live = arena_live(map_struct, shard);
+    if (live * 2 > used) {
+        return;
+    }
+
+    arena_compact(map_struct, shard, live);
+}
+
+void str_free(shard_t *shard)
+{
+    arena_free(shard->arena);
+    shard->arena = NULL;
+}
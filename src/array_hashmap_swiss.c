@@ -0,0 +1,495 @@
+#include "array_hashmap_internal.h"
+#include <stdlib.h>
+#include <string.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__AVX2__)
+#define GROUP_WIDTH 32
+#else
+#define GROUP_WIDTH 16
+#endif
+
+#define SWISS_MAX_LOAD 0.875
+
+typedef uint32_t group_mask_t;
+
+typedef struct __attribute__((packed)) slot {
+    array_hashmap_hash hash;
+} slot_t;
+
+enum ctrl { ctrl_empty = 0x80, ctrl_deleted = 0xfe };
+
+#define slot_i(table, index) ((slot_t *)&(table)->map[(size_t)(index) * map_struct->elem_size])
+#define slot_hash(slot) (is_store_hash() ? (slot)->hash : elem_add_hash(elem_data(slot)))
+#define slot_hash_differs(slot, slot_hash) (is_store_hash() && (slot)->hash != (slot_hash))
+#define is_full(ctrl) (!((ctrl) & 0x80))
+
+#define hash_tag(hash) ((uint8_t)((hash) & 0x7f))
+#define probe_count(table) (((table)->map_size + GROUP_WIDTH - 1) / GROUP_WIDTH)
+#define probe_next(table, pos) ((pos) + GROUP_WIDTH >= (table)->map_size ? \
+                                    (pos) + GROUP_WIDTH - (table)->map_size : \
+                                    (pos) + GROUP_WIDTH)
+
+static group_mask_t group_match(const uint8_t *group, uint8_t tag)
+{
+#if defined(__AVX2__)
+    __m256i ctrl = _mm256_loadu_si256((const __m256i *)group);
+    return (group_mask_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(ctrl, _mm256_set1_epi8(tag)));
+#elif defined(__SSE2__)
+    __m128i ctrl = _mm_loadu_si128((const __m128i *)group);
+    return (group_mask_t)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(tag)));
+#else
+    group_mask_t mask = 0;
+    int32_t i = 0;
+
+    for (i = 0; i < GROUP_WIDTH; i++) {
+        if (group[i] == tag) {
+            mask |= (group_mask_t)1 << i;
+        }
+    }
+
+    return mask;
+#endif
+}
+
+static group_mask_t group_match_free(const uint8_t *group)
+{
+#if defined(__AVX2__)
+    return (group_mask_t)_mm256_movemask_epi8(_mm256_loadu_si256((const __m256i *)group));
+#elif defined(__SSE2__)
+    return (group_mask_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)group));
+#else
+    group_mask_t mask = 0;
+    int32_t i = 0;
+
+    for (i = 0; i < GROUP_WIDTH; i++) {
+        if (!is_full(group[i])) {
+            mask |= (group_mask_t)1 << i;
+        }
+    }
+
+    return mask;
+#endif
+}
+
+static int32_t group_index(table_t *table, int32_t pos, group_mask_t mask)
+{
+    int32_t index = 0;
+
+    index = pos + __builtin_ctz(mask);
+    if (index >= table->map_size) {
+        index -= table->map_size;
+    }
+
+    return index;
+}
+
+static void ctrl_set(table_t *table, int32_t index, uint8_t ctrl)
+{
+    table->ctrl[index] = ctrl;
+    if (index < GROUP_WIDTH) {
+        table->ctrl[table->map_size + index] = ctrl;
+    }
+}
+
+static size_t swiss_table_bytes(hashmap_t *map_struct, int32_t map_size)
+{
+    if (map_size < GROUP_WIDTH) {
+        map_size = GROUP_WIDTH;
+    }
+
+    return (size_t)map_size * map_struct->elem_size + map_size + GROUP_WIDTH;
+}
+
+static array_hashmap_bool swiss_table_init(hashmap_t *map_struct, table_t *table,
+                                           int32_t map_size, char *map)
+{
+    double max_load = 0;
+
+    if (map_size < GROUP_WIDTH) {
+        map_size = GROUP_WIDTH;
+    }
+
+    table->map = map ? map : table_alloc(swiss_table_bytes(map_struct, map_size));
+    if (!table->map) {
+        return 0;
+    }
+
+    max_load = map_struct->max_load;
+    if (max_load > SWISS_MAX_LOAD) {
+        max_load = SWISS_MAX_LOAD;
+    }
+
+    table->ctrl = (uint8_t *)&table->map[(size_t)map_size * map_struct->elem_size];
+    table->map_size = map_size;
+    table->max_size = map_size * max_load;
+    table->now_in_map = 0;
+    table->deleted = 0;
+
+    memset(table->ctrl, ctrl_empty, map_size + GROUP_WIDTH);
+
+    return 1;
+}
+
+static int32_t swiss_lookup(hashmap_t *map_struct, table_t *table, array_hashmap_hash hash,
+                            const void *key_data, cmp_t cmp, int32_t cmp_stat)
+{
+    int32_t probe = 0;
+    int32_t pos = 0;
+    const uint8_t *group = NULL;
+    group_mask_t mask = 0;
+
+    int32_t index = 0;
+    slot_t *slot = NULL;
+
+    pos = index_hash(table, hash);
+    for (probe = 0; probe < probe_count(table); probe++) {
+        group = &table->ctrl[pos];
+
+        mask = group_match(group, hash_tag(hash));
+        while (mask) {
+            index = group_index(table, pos, mask);
+            slot = slot_i(table, index);
+            if (!slot_hash_differs(slot, hash) &&
+                stat_cmp(cmp_stat, cmp, key_data, elem_data(slot))) {
+                return index;
+            }
+
+            mask &= mask - 1;
+        }
+
+        if (group_match(group, ctrl_empty)) {
+            break;
+        }
+
+        pos = probe_next(table, pos);
+    }
+
+    return -1;
+}
+
+static void slot_set(hashmap_t *map_struct, slot_t *slot, array_hashmap_hash add_hash,
+                     const void *add_elem_data, array_hashmap_time expire)
+{
+    if (is_store_hash()) {
+        slot->hash = add_hash;
+    }
+    if (is_ttl()) {
+        data_expire(elem_data(slot)) = expire;
+    }
+    memcpy(elem_data(slot), add_elem_data, map_struct->data_size);
+}
+
+static int32_t swiss_insert(hashmap_t *map_struct, table_t *table, array_hashmap_hash add_hash,
+                            const void *add_elem_data, array_hashmap_time expire)
+{
+    int32_t pos = 0;
+    int32_t distance = 0;
+    group_mask_t mask = 0;
+
+    int32_t index = 0;
+
+    pos = index_hash(table, add_hash);
+    while (!(mask = group_match_free(&table->ctrl[pos]))) {
+        pos = probe_next(table, pos);
+        distance++;
+    }
+
+    stat_add(stat_free_search, 1);
+    stat_add(stat_free_distance, distance);
+
+    index = group_index(table, pos, mask);
+    if (table->ctrl[index] == ctrl_deleted) {
+        table->deleted--;
+    }
+
+    ctrl_set(table, index, hash_tag(add_hash));
+    slot_set(map_struct, slot_i(table, index), add_hash, add_elem_data, expire);
+
+    table->now_in_map++;
+
+    return index;
+}
+
+static void swiss_tombstone(table_t *table, int32_t index)
+{
+    ctrl_set(table, index, ctrl_deleted);
+    table->deleted++;
+    table->now_in_map--;
+}
+
+static void swiss_erase(table_t *table, int32_t index)
+{
+    int32_t index_before = 0;
+    group_mask_t empty_before = 0;
+    group_mask_t empty_after = 0;
+    int32_t full_before = 0;
+
+    index_before = index - GROUP_WIDTH;
+    if (index_before < 0) {
+        index_before += table->map_size;
+    }
+
+    empty_before = group_match(&table->ctrl[index_before], ctrl_empty);
+    empty_after = group_match(&table->ctrl[index], ctrl_empty);
+
+    if (empty_before && empty_after) {
+        full_before = __builtin_clz(empty_before) - (32 - GROUP_WIDTH);
+    }
+
+    if (empty_before && empty_after && full_before + __builtin_ctz(empty_after) < GROUP_WIDTH) {
+        ctrl_set(table, index, ctrl_empty);
+        table->now_in_map--;
+    } else {
+        swiss_tombstone(table, index);
+    }
+}
+
+static array_hashmap_ret_t swiss_add(hashmap_t *map_struct, shard_t *shard,
+                                     array_hashmap_hash add_hash, const void *add_elem_data,
+                                     void *res_elem_data, on_already_in_t on_already_in,
+                                     array_hashmap_time expire, void **hashmap_elem_data)
+{
+    table_t *table = NULL;
+    int32_t index = 0;
+    slot_t *slot = NULL;
+
+    table = &shard->table;
+
+    index = swiss_lookup(map_struct, table, add_hash, add_elem_data, map_struct->add_cmp,
+                         stat_add_cmp);
+    if (index >= 0) {
+        slot = slot_i(table, index);
+        *hashmap_elem_data = elem_data(slot);
+        if (data_is_expired(elem_data(slot), time_now())) {
+            slot_set(map_struct, slot, add_hash, add_elem_data, expire);
+            return array_hashmap_elem_added;
+        }
+
+        hashmap_already_in(map_struct, elem_data(slot), add_elem_data, res_elem_data,
+                           on_already_in, expire);
+        return array_hashmap_elem_already_in;
+    }
+
+    if (all_in_map(shard) >= table->max_size) {
+        return array_hashmap_full;
+    }
+
+    index = swiss_insert(map_struct, table, add_hash, add_elem_data, expire);
+    *hashmap_elem_data = elem_data(slot_i(table, index));
+
+    return array_hashmap_elem_added;
+}
+
+static void *swiss_find(hashmap_t *map_struct, table_t *table, array_hashmap_hash find_hash,
+                        const void *find_elem_data)
+{
+    int32_t index = 0;
+
+    index = swiss_lookup(map_struct, table, find_hash, find_elem_data, map_struct->find_cmp,
+                         stat_find_cmp);
+    if (index < 0 || data_is_expired(elem_data(slot_i(table, index)), time_now())) {
+        return NULL;
+    }
+
+    return elem_data(slot_i(table, index));
+}
+
+static array_hashmap_ret_t swiss_del(hashmap_t *map_struct, table_t *table,
+                                     array_hashmap_hash del_hash, const void *del_elem_data,
+                                     void *res_elem_data)
+{
+    int32_t index = 0;
+
+    index = swiss_lookup(map_struct, table, del_hash, del_elem_data, map_struct->del_cmp,
+                         stat_del_cmp);
+    if (index < 0) {
+        return array_hashmap_elem_not_deled;
+    }
+
+    if (data_is_expired(elem_data(slot_i(table, index)), time_now())) {
+        swiss_erase(table, index);
+        return array_hashmap_elem_not_deled;
+    }
+
+    if (res_elem_data) {
+        memcpy(res_elem_data, elem_data(slot_i(table, index)), map_struct->data_size);
+    }
+
+    swiss_erase(table, index);
+
+    return array_hashmap_elem_deled;
+}
+
+static int32_t swiss_del_by_func(hashmap_t *map_struct, table_t *table, int32_t from,
+                                 int32_t to, del_func_t del_func)
+{
+    array_hashmap_time now = 0;
+    int32_t del_count = 0;
+    int32_t i = 0;
+
+    now = time_now();
+
+    for (i = from; i < to; i++) {
+        if (!is_full(table->ctrl[i])) {
+            continue;
+        }
+
+        if (data_is_del(elem_data(slot_i(table, i)), del_func, now)) {
+            swiss_erase(table, i);
+            del_count++;
+        }
+    }
+
+    return del_count;
+}
+
+static void swiss_del_mark(hashmap_t *map_struct, table_t *table, int32_t from, int32_t to,
+                           del_func_t del_func, uint8_t *marks)
+{
+    array_hashmap_time now = 0;
+    int32_t i = 0;
+
+    now = time_now();
+
+    for (i = from; i < to; i++) {
+        marks[i] = 0;
+
+        if (is_full(table->ctrl[i]) && data_is_del(elem_data(slot_i(table, i)), del_func, now)) {
+            marks[i] = mark_del;
+        }
+    }
+}
+
+static int32_t swiss_del_marked(hashmap_t *map_struct, table_t *table, int32_t from, int32_t to,
+                                const uint8_t *marks)
+{
+    int32_t del_count = 0;
+    int32_t i = 0;
+
+    (void)map_struct;
+
+    for (i = from; i < to; i++) {
+        if (!(marks[i] & mark_del)) {
+            continue;
+        }
+
+        if (i - GROUP_WIDTH >= from && i + GROUP_WIDTH <= to) {
+            swiss_erase(table, i);
+        } else {
+            swiss_tombstone(table, i);
+        }
+        del_count++;
+    }
+
+    return del_count;
+}
+
+static array_hashmap_bool swiss_foreach(hashmap_t *map_struct, table_t *table, int32_t *index,
+                                        int32_t end, array_hashmap_time now,
+                                        foreach_func_t foreach_func, void *arg, int32_t *visited)
+{
+    int32_t i = 0;
+
+    while (*index < end) {
+        i = (*index)++;
+
+        if (!is_full(table->ctrl[i]) || data_is_expired(elem_data(slot_i(table, i)), now)) {
+            continue;
+        }
+
+        (*visited)++;
+        if (foreach_func(elem_data(slot_i(table, i)), arg) == array_hashmap_foreach_stop) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static void swiss_prefetch(hashmap_t *map_struct, table_t *table, array_hashmap_hash hash,
+                           int32_t depth)
+{
+    int32_t pos = 0;
+    group_mask_t mask = 0;
+
+    pos = index_hash(table, hash);
+    if (!depth) {
+        __builtin_prefetch(&table->ctrl[pos]);
+        __builtin_prefetch(slot_i(table, pos));
+        return;
+    }
+
+    mask = group_match(&table->ctrl[pos], hash_tag(hash));
+    if (mask) {
+        __builtin_prefetch(slot_i(table, group_index(table, pos, mask)));
+    }
+}
+
+static array_hashmap_bool swiss_migrate(hashmap_t *map_struct, shard_t *shard, int32_t index)
+{
+    table_t *old_table = NULL;
+    slot_t *slot = NULL;
+
+    old_table = &shard->old_table;
+
+    if (!is_full(old_table->ctrl[index])) {
+        return 1;
+    }
+
+    slot = slot_i(old_table, index);
+    if (!data_is_expired(elem_data(slot), time_now())) {
+        swiss_insert(map_struct, &shard->table, slot_hash(slot), elem_data(slot),
+                     is_ttl() ? data_expire(elem_data(slot)) : array_hashmap_no_expire);
+    }
+
+    ctrl_set(old_table, index, ctrl_deleted);
+    old_table->now_in_map--;
+
+    return 1;
+}
+
+static void swiss_migrate_key(hashmap_t *map_struct, shard_t *shard, array_hashmap_hash hash,
+                              const void *key_data, cmp_t cmp, int32_t cmp_stat)
+{
+    int32_t index = 0;
+
+    index = swiss_lookup(map_struct, &shard->old_table, hash, key_data, cmp, cmp_stat);
+    if (index >= 0) {
+        swiss_migrate(map_struct, shard, index);
+    }
+}
+
+static void swiss_stats(hashmap_t *map_struct, table_t *table, array_hashmap_stats_t *stats)
+{
+    int32_t i = 0;
+    int32_t probe = 0;
+
+    for (i = 0; i < table->map_size; i++) {
+        if (!is_full(table->ctrl[i])) {
+            continue;
+        }
+
+        probe = i - index_hash(table, slot_hash(slot_i(table, i)));
+        if (probe < 0) {
+            probe += table->map_size;
+        }
+        probe /= GROUP_WIDTH;
+
+        if (probe) {
+            stats->non_owner_count++;
+        }
+
+        stats_chain_add(stats, probe + 1);
+    }
+}
+
+const engine_t swiss_engine = { 0,                swiss_table_init,  swiss_table_bytes,
+                                swiss_add,        swiss_find,        NULL,
+                                swiss_del,        swiss_del_by_func, swiss_del_mark,
+                                swiss_del_marked, swiss_foreach,     swiss_prefetch,
+                                swiss_migrate,    swiss_migrate_key, swiss_stats };
@@ -10,6 +10,7 @@
 #include <stdarg.h>
 #include <pthread.h>
 #include <malloc.h>
+#include <sys/mman.h>
 
 #define FIRST_TEST_TIME 10
 #define SECOND_TEST_TIME 100
@@ -18,18 +19,43 @@
 #define MAX_DOMAIN_LEN 300
 #define DOMAINS_FILE_SIZE_MB 100
 
+#define SWISS_MAX_LOAD 0.875
+#define CUCKOO_MAX_LOAD 0.97
+#define FIND_BATCH_SIZE 64
+#define SNAPSHOT_PATH "hashmap_test.snapshot"
+#define SNAPSHOT_HASH_ID 1
+#define SHARED_NAME "/hashmap_test"
+#define OPTIMISTIC_READERS 4
+#define DOMAIN_HASH_SEED UINT64_C(0x9e3779b97f4a7c15)
+
 typedef struct domain_data {
     uint32_t domain_pos;
     int32_t time;
 } domain_data_t;
 
+typedef struct domain_ptr {
+    const char *domain;
+    int32_t time;
+} domain_ptr_t;
+
+typedef struct domain_str {
+    array_hashmap_str_t domain;
+    int32_t time;
+} domain_str_t;
+
 char *domains = NULL;
 char *domains_random = NULL;
+int64_t domains_size = 0;
 int32_t *domain_offsets = NULL;
 int32_t domains_map_size = 0;
 array_hashmap_t domains_map_struct = NULL;
 
 volatile int32_t thread_count = 0;
+volatile int32_t foreach_count = 0;
+volatile int32_t resize_add_done = 0;
+volatile int32_t optimistic_write_done = 0;
+
+array_hashmap_time expire_now = 0;
 
 pthread_barrier_t threads_barrier_start;
 pthread_barrier_t threads_barrier_end;
@@ -40,20 +66,13 @@ size_t heap_in_use(void)
     return (size_t)mi.uordblks + (size_t)mi.hblkhd;
 }
 
-array_hashmap_hash djb33_hash(const char *s)
-{
-    uint32_t h = 5381;
-    while (*s) {
-        h += (h << 5);
-        h ^= *s++;
-    }
-    return h;
-}
-
 array_hashmap_hash domain_add_hash(const void *add_elem_data)
 {
     const domain_data_t *elem = add_elem_data;
-    return djb33_hash(&domains[elem->domain_pos]);
+    const char *domain = &domains[elem->domain_pos];
+
+    return array_hashmap_hash_seed(array_hashmap_hash_wy, DOMAIN_HASH_SEED, domain,
+                                   strlen(domain));
 }
 
 array_hashmap_bool domain_add_cmp(const void *add_elem_data, const void *hashmap_elem_data)
@@ -67,7 +86,7 @@ array_hashmap_bool domain_add_cmp(const void *add_elem_data, const void *hashmap
 array_hashmap_hash domain_find_hash(const void *find_elem_data)
 {
     const char *elem = find_elem_data;
-    return djb33_hash(elem);
+    return array_hashmap_hash_seed(array_hashmap_hash_wy, DOMAIN_HASH_SEED, elem, strlen(elem));
 }
 
 array_hashmap_bool domain_find_cmp(const void *find_elem_data, const void *hashmap_elem_data)
@@ -78,6 +97,31 @@ array_hashmap_bool domain_find_cmp(const void *find_elem_data, const void *hashm
     return !strcmp(elem1, &domains[elem2->domain_pos]);
 }
 
+/* An optimistic read may compare an element torn by a writer, its offset can be anything */
+array_hashmap_bool domain_find_cmp_clamped(const void *find_elem_data,
+                                           const void *hashmap_elem_data)
+{
+    const char *elem1 = find_elem_data;
+    const domain_data_t *elem2 = hashmap_elem_data;
+
+    if (elem2->domain_pos >= domains_size) {
+        return 0;
+    }
+
+    return !strcmp(elem1, &domains[elem2->domain_pos]);
+}
+
+array_hashmap_hash domain_collide_hash(const void *add_elem_data)
+{
+    const domain_data_t *elem = add_elem_data;
+
+    if (elem->time < 0) {
+        return 0;
+    }
+
+    return domain_add_hash(add_elem_data);
+}
+
 array_hashmap_bool domain_on_already_in(const void *add_elem_data, const void *hashmap_elem_data)
 {
     const domain_data_t *elem1 = add_elem_data;
@@ -90,6 +134,26 @@ array_hashmap_bool domain_on_already_in(const void *add_elem_data, const void *h
     }
 }
 
+void domain_upsert_init(void *hashmap_elem_data, const void *add_elem_data, void *arg)
+{
+    domain_data_t *elem = hashmap_elem_data;
+
+    (void)add_elem_data;
+    (void)arg;
+
+    elem->time = 1;
+}
+
+void domain_upsert_update(void *hashmap_elem_data, const void *add_elem_data, void *arg)
+{
+    domain_data_t *elem = hashmap_elem_data;
+
+    (void)add_elem_data;
+
+    elem->time++;
+    (*(int32_t *)arg)++;
+}
+
 array_hashmap_bool domain_del_func(const void *del_elem_data)
 {
     const domain_data_t *elem = del_elem_data;
@@ -101,6 +165,54 @@ array_hashmap_bool domain_del_func(const void *del_elem_data)
     }
 }
 
+array_hashmap_bool domain_str_del_func(const void *del_elem_data)
+{
+    const domain_str_t *elem = del_elem_data;
+
+    if (elem->time % 8) {
+        return array_hashmap_del_by_func;
+    } else {
+        return array_hashmap_not_del_by_func;
+    }
+}
+
+char *domain_str(int32_t index, char *short_domain)
+{
+    if (index % 2) {
+        sprintf(short_domain, "%d", index);
+        return short_domain;
+    }
+
+    return &domains[domain_offsets[index]];
+}
+
+array_hashmap_bool domain_foreach_func(const void *elem_data, void *arg)
+{
+    const domain_data_t *elem = elem_data;
+    int32_t *count = arg;
+
+    if (elem->time == SECOND_TEST_TIME) {
+        (*count)++;
+    }
+
+    return array_hashmap_foreach_continue;
+}
+
+array_hashmap_bool domain_visit_func(const void *elem_data, void *arg)
+{
+    const domain_data_t *elem = elem_data;
+    int32_t *visits = arg;
+
+    visits[elem->time]++;
+
+    return array_hashmap_foreach_continue;
+}
+
+array_hashmap_time domain_time(void)
+{
+    return expire_now;
+}
+
 void clean_cache(void)
 {
     int32_t i = 0;
@@ -235,6 +347,45 @@ void *find_thread_func(void *arg)
     return NULL;
 }
 
+void *find_batch_thread_func(void *arg)
+{
+    int32_t i = 0;
+    int32_t j = 0;
+    int32_t batch_size = 0;
+    const void *find_elems[FIND_BATCH_SIZE];
+    domain_data_t res_elems[FIND_BATCH_SIZE];
+    array_hashmap_ret_t find_res[FIND_BATCH_SIZE];
+    int32_t finded_count;
+    int32_t thread_num;
+    int32_t end;
+
+    thread_num = (int64_t)arg;
+    end = (domains_map_size / thread_count) * (thread_num + 1);
+
+    pthread_barrier_wait(&threads_barrier_start);
+    for (i = (domains_map_size / thread_count) * thread_num; i < end; i += batch_size) {
+        batch_size = end - i < FIND_BATCH_SIZE ? end - i : FIND_BATCH_SIZE;
+        for (j = 0; j < batch_size; j++) {
+            find_elems[j] = &domains[domain_offsets[i + j]];
+        }
+
+        finded_count = array_hashmap_find_batch(domains_map_struct, find_elems, batch_size,
+                                                res_elems, find_res);
+        if (finded_count != batch_size) {
+            errmsg("array_hashmap: Check that all values are inserted by batch error\n");
+        }
+        for (j = 0; j < batch_size; j++) {
+            if (find_res[j] != array_hashmap_elem_finded ||
+                res_elems[j].time != FIRST_TEST_TIME) {
+                errmsg("array_hashmap: Check that all values are inserted by batch error\n");
+            }
+        }
+    }
+    pthread_barrier_wait(&threads_barrier_end);
+
+    return NULL;
+}
+
 void *no_find_thread_func(void *arg)
 {
     int32_t i = 0;
@@ -310,6 +461,73 @@ void *check_update_thread_func(void *arg)
     return NULL;
 }
 
+void *foreach_thread_func(void *arg)
+{
+    int32_t count = 0;
+    int32_t thread_num;
+
+    thread_num = (int64_t)arg;
+
+    pthread_barrier_wait(&threads_barrier_start);
+    if (array_hashmap_foreach_part(domains_map_struct, thread_num, thread_count,
+                                   domain_foreach_func, &count) < 0) {
+        errmsg("array_hashmap: Visit all values error\n");
+    }
+    __atomic_add_fetch(&foreach_count, count, __ATOMIC_RELAXED);
+    pthread_barrier_wait(&threads_barrier_end);
+
+    return NULL;
+}
+
+void *resize_add_thread_func(void *arg)
+{
+    int32_t i = 0;
+    domain_data_t add_elem;
+
+    (void)arg;
+
+    for (i = domains_map_size / 2; i < domains_map_size; i++) {
+        add_elem.domain_pos = domain_offsets[i];
+        add_elem.time = i;
+
+        if (array_hashmap_add_elem(domains_map_struct, &add_elem, NULL,
+                                   array_hashmap_save_old_func) != array_hashmap_elem_added) {
+            errmsg("array_hashmap: Resize add values error\n");
+        }
+    }
+    __atomic_store_n(&resize_add_done, 1, __ATOMIC_RELEASE);
+
+    return NULL;
+}
+
+void *optimistic_find_thread_func(void *arg)
+{
+    int32_t i = 0;
+    domain_data_t find_elem;
+    int32_t find_res;
+    char *domain;
+
+    (void)arg;
+
+    do {
+        for (i = 0; i < domains_map_size / 4; i++) {
+            domain = &domains[domain_offsets[i]];
+            find_res = array_hashmap_find_elem(domains_map_struct, domain, &find_elem);
+            if (find_res != array_hashmap_elem_finded || find_elem.time != i) {
+                errmsg("array_hashmap: Optimistic read find error\n");
+            }
+
+            domain = &domains_random[domain_offsets[i]];
+            find_res = array_hashmap_find_elem(domains_map_struct, domain, NULL);
+            if (find_res != array_hashmap_elem_not_finded) {
+                errmsg("array_hashmap: Optimistic read no find error\n");
+            }
+        }
+    } while (!__atomic_load_n(&optimistic_write_done, __ATOMIC_ACQUIRE));
+
+    return NULL;
+}
+
 void *del_thread_func(void *arg)
 {
     int32_t i = 0;
@@ -355,6 +573,31 @@ int32_t main(void)
     int32_t find_res;
 
     int32_t del_elem_by_func_res;
+    int32_t upsert_count = 0;
+    int32_t upsert_round = 0;
+
+    array_hashmap_t seed_map_struct[2];
+    int32_t hash_diff = 0;
+
+    domain_ptr_t ptr_elem;
+    domain_str_t str_elem;
+    array_hashmap_str_t str_key;
+    char short_domain[16];
+
+    FILE *snapshot_file = NULL;
+    int snapshot_byte = 0;
+
+    int32_t *visits = NULL;
+    int32_t map_size = 0;
+    int32_t added_count = 0;
+    int32_t finded_count = 0;
+    int32_t skipped_count = 0;
+    int32_t swap_offset = 0;
+
+    array_hashmap_cursor_t cursor;
+    array_hashmap_lease_t lease;
+    array_hashmap_stats_t stats;
+    array_hashmap_latency_t latency;
 
     struct timeval now_timeval_start;
     struct timeval now_timeval_end;
@@ -366,6 +609,8 @@ int32_t main(void)
     int32_t one_op_time_ns[100];
 
     pthread_t thread;
+    pthread_t reader_threads[OPTIMISTIC_READERS];
+    int32_t write_round = 0;
     void *set_arg;
 
     int32_t domain_len;
@@ -375,19 +620,30 @@ int32_t main(void)
     char *print_data[100];
 
     int32_t domains_map_size_all = 0;
+    int32_t shard_count = 0;
 
     size_t mem_base = 0;
     int64_t mem_array = 0;
 
+    array_hashmap_opts_t opts;
+    array_hashmap_engine_t engine;
+    char *engine_names[3];
+
     print_data[0] = "Load %;";
     print_data[1] = "Mem MB;";
     print_data[2] = "Insert;";
     print_data[3] = "Lookup hit;";
-    print_data[4] = "Lookup miss;";
-    print_data[5] = "Update;";
-    print_data[6] = "Verify update;";
-    print_data[7] = "Delete each;";
-    print_data[8] = "Delete all;";
+    print_data[4] = "Lookup batch;";
+    print_data[5] = "Lookup miss;";
+    print_data[6] = "Update;";
+    print_data[7] = "Verify update;";
+    print_data[8] = "Foreach;";
+    print_data[9] = "Delete each;";
+    print_data[10] = "Delete all;";
+
+    engine_names[array_hashmap_engine_chain] = "chain";
+    engine_names[array_hashmap_engine_swiss] = "swiss";
+    engine_names[array_hashmap_engine_cuckoo] = "cuckoo";
 
     srand(time(NULL));
 
@@ -421,6 +677,7 @@ int32_t main(void)
         }
 
         domains_file_size = processed;
+        domains_size = domains_file_size;
     }
     /* Random domain list generator */
 
@@ -467,147 +724,1422 @@ int32_t main(void)
     }
     /* Check is_thread_safet */
 
-    for (thread_count = 1; thread_count <= 8; thread_count++) {
-        domains_map_size = domains_map_size_all - domains_map_size_all % thread_count;
-        printf("Domains count: %d\n", domains_map_size);
-        printf("Threads count: %d\n", thread_count);
-        printf("\n");
+    /* Check growable map */
+    {
+        memset(&opts, 0, sizeof(opts));
+        opts.flags =
+            array_hashmap_opt_grow | array_hashmap_opt_shrink | array_hashmap_opt_store_hash;
 
-        printf("array_hashmap\n");
-        for (i = 0; i < 9; i++) {
-            printf("%s", print_data[i]);
+        domains_map_struct = array_hashmap_init_opts(1, 1.0, sizeof(domain_data_t), &opts);
+        if (domains_map_struct == NULL) {
+            errmsg("Init growable error\n");
         }
-        printf("\n");
 
-        for (step = 1.00; step > 0.5; step -= 0.01) {
-            time_index = 0;
+        array_hashmap_set_func(domains_map_struct, domain_add_hash, domain_add_cmp,
+                               domain_find_hash, domain_find_cmp, domain_find_hash,
+                               domain_find_cmp);
+
+        for (i = 0; i < domains_map_size; i++) {
+            add_elem.domain_pos = domain_offsets[i];
+            add_elem.time = FIRST_TEST_TIME;
 
-            /* Get memory usage */
-            mem_base = heap_in_use();
-            /* Get memory usage */
+            add_res = array_hashmap_add_elem(domains_map_struct, &add_elem, NULL,
+                                             array_hashmap_save_old_func);
+            if (add_res != array_hashmap_elem_added) {
+                errmsg("Growable add values error\n");
+            }
+        }
 
-            /* Init */
-            domains_map_struct =
-                array_hashmap_init(domains_map_size / step, 1.0, sizeof(domain_data_t));
-            if (domains_map_struct == NULL) {
-                errmsg("array_hashmap: Init error\n");
+        for (i = 0; i < domains_map_size; i++) {
+            domain = &domains[domain_offsets[i]];
+            find_res = array_hashmap_find_elem(domains_map_struct, domain, &find_elem);
+            if (find_res != array_hashmap_elem_finded || find_elem.time != FIRST_TEST_TIME) {
+                errmsg("Growable check that all values are inserted error\n");
             }
+        }
+
+        for (i = 0; i < domains_map_size / 2; i++) {
+            add_elem.domain_pos = domain_offsets[i];
+            add_elem.time = SECOND_TEST_TIME;
 
-            array_hashmap_set_func(domains_map_struct, domain_add_hash, domain_add_cmp,
-                                   domain_find_hash, domain_find_cmp, domain_find_hash,
-                                   domain_find_cmp);
-            /* Init */
+            add_res = array_hashmap_add_elem(domains_map_struct, &add_elem, NULL,
+                                             array_hashmap_save_new_func);
+            if (add_res != array_hashmap_elem_already_in) {
+                errmsg("Growable update values error\n");
+            }
+        }
 
-            /* Add values */
-            RUN_THREAD(add);
-            /* Add values */
+        del_elem_by_func_res = 0;
+        array_hashmap_cursor_init(&cursor, 0, 1, 0);
+        while (!array_hashmap_cursor_is_end(&cursor)) {
+            del_elem_by_func_res += array_hashmap_del_elem_by_func_step(
+                domains_map_struct, domain_del_func, &cursor, 1024);
+        }
+        if (del_elem_by_func_res != domains_map_size / 2) {
+            errmsg("Growable delete by func step error\n");
+        }
 
-            /* Get memory usage */
-            mem_array = heap_in_use() - mem_base;
-            /* Get memory usage */
+        for (i = domains_map_size / 2; i < domains_map_size; i++) {
+            domain = &domains[domain_offsets[i]];
+            if (array_hashmap_del_elem(domains_map_struct, domain, NULL) !=
+                array_hashmap_elem_deled) {
+                errmsg("Growable delete everything individually error\n");
+            }
+        }
 
-            /* Check that all values are inserted */
-            RUN_THREAD(find);
-            /* Check that all values are inserted */
+        if (array_hashmap_now_in_map(domains_map_struct) != 0) {
+            errmsg("Growable check that everything is deleted error\n");
+        }
 
-            /* Check that there are no non-inserted elements */
-            RUN_THREAD(no_find);
-            /* Check that there are no non-inserted elements */
+        array_hashmap_del(&domains_map_struct);
+    }
+    /* Check growable map */
 
-            /* Update values */
-            RUN_THREAD(update);
-            /* Update values */
+    /* Check sharded map */
+    {
+        memset(&opts, 0, sizeof(opts));
+        opts.shard_count = 8;
 
-            /* Check the updated values */
-            RUN_THREAD(check_update);
-            /* Check the updated values */
+        domains_map_struct =
+            array_hashmap_init_opts(domains_map_size * 2, 1.0, sizeof(domain_data_t), &opts);
+        if (domains_map_struct == NULL) {
+            errmsg("Init sharded error\n");
+        }
 
-            /* Delete everything individually */
-            RUN_THREAD(del);
-            /* Delete everything individually */
+        array_hashmap_set_func(domains_map_struct, domain_add_hash, domain_add_cmp,
+                               domain_find_hash, domain_find_cmp, domain_find_hash,
+                               domain_find_cmp);
 
-            /* Check that everything is deleted */
-            for (i = 0; i < domains_map_size; i++) {
-                domain = &domains[domain_offsets[i]];
-                find_res = array_hashmap_find_elem(domains_map_struct, domain, &find_elem);
-                if (find_res != array_hashmap_elem_not_finded) {
-                    errmsg("array_hashmap: Check that everything is deleted error\n");
+        for (i = 0; i < domains_map_size; i++) {
+            add_elem.domain_pos = domain_offsets[i];
+            add_elem.time = FIRST_TEST_TIME;
+
+            add_res = array_hashmap_add_elem(domains_map_struct, &add_elem, NULL,
+                                             array_hashmap_save_old_func);
+            if (add_res != array_hashmap_elem_added) {
+                errmsg("Sharded add values error\n");
+            }
+        }
+
+        if (array_hashmap_now_in_map(domains_map_struct) != domains_map_size) {
+            errmsg("Sharded count values error\n");
+        }
+
+        /* Takes the locks of all shards, a lock left taken hangs the finds below */
+        array_hashmap_set_func(domains_map_struct, domain_add_hash, domain_add_cmp,
+                               domain_find_hash, domain_find_cmp, domain_find_hash,
+                               domain_find_cmp);
+
+        for (i = 0; i < domains_map_size; i++) {
+            domain = &domains[domain_offsets[i]];
+            find_res = array_hashmap_find_elem(domains_map_struct, domain, &find_elem);
+            if (find_res != array_hashmap_elem_finded || find_elem.time != FIRST_TEST_TIME) {
+                errmsg("Sharded check that all values are inserted error\n");
+            }
+
+            domain = &domains_random[domain_offsets[i]];
+            find_res = array_hashmap_find_elem(domains_map_struct, domain, &find_elem);
+            if (find_res != array_hashmap_elem_not_finded) {
+                errmsg("Sharded check that there are no non-inserted elements error\n");
+            }
+        }
+
+        for (i = 0; i < domains_map_size / 2; i++) {
+            add_elem.domain_pos = domain_offsets[i];
+            add_elem.time = SECOND_TEST_TIME;
+
+            add_res = array_hashmap_add_elem(domains_map_struct, &add_elem, NULL,
+                                             array_hashmap_save_new_func);
+            if (add_res != array_hashmap_elem_already_in) {
+                errmsg("Sharded update values error\n");
+            }
+        }
+
+        del_elem_by_func_res = array_hashmap_del_elem_by_func(domains_map_struct, domain_del_func);
+        if (del_elem_by_func_res != domains_map_size / 2 ||
+            array_hashmap_now_in_map(domains_map_struct) !=
+                domains_map_size - domains_map_size / 2) {
+            errmsg("Sharded delete by func error\n");
+        }
+
+        for (i = 0; i < domains_map_size; i++) {
+            domain = &domains[domain_offsets[i]];
+            find_res = array_hashmap_find_elem(domains_map_struct, domain, &find_elem);
+            if (find_res != (i < domains_map_size / 2 ? array_hashmap_elem_not_finded
+                                                      : array_hashmap_elem_finded)) {
+                errmsg("Sharded check the values left after delete by func error\n");
+            }
+        }
+
+        array_hashmap_del(&domains_map_struct);
+
+        /* Every shard takes 8 elements, the first full one fails its adds before the map is full */
+        domains_map_struct = array_hashmap_init_opts(64, 1.0, sizeof(domain_data_t), &opts);
+        if (domains_map_struct == NULL) {
+            errmsg("Init full sharded error\n");
+        }
+
+        array_hashmap_set_func(domains_map_struct, domain_add_hash, domain_add_cmp,
+                               domain_find_hash, domain_find_cmp, domain_find_hash,
+                               domain_find_cmp);
+
+        added_count = 0;
+        skipped_count = 0;
+        for (i = 0; i < domains_map_size; i++) {
+            add_elem.domain_pos = domain_offsets[i];
+            add_elem.time = FIRST_TEST_TIME;
+
+            add_res = array_hashmap_add_elem(domains_map_struct, &add_elem, NULL,
+                                             array_hashmap_save_old_func);
+            if (add_res == array_hashmap_elem_added) {
+                added_count++;
+            } else if (add_res == array_hashmap_full) {
+                if (!skipped_count && added_count == 64) {
+                    errmsg("Sharded full before the map is full error\n");
                 }
+                skipped_count++;
+            } else {
+                errmsg("Sharded full add values error\n");
+            }
+
+            domain = &domains[domain_offsets[i]];
+            find_res = array_hashmap_find_elem(domains_map_struct, domain, NULL);
+            if (find_res != (add_res == array_hashmap_full ? array_hashmap_elem_not_finded
+                                                           : array_hashmap_elem_finded)) {
+                errmsg("Sharded full find error\n");
+            }
+        }
+
+        if (!skipped_count || added_count != 64 ||
+            array_hashmap_now_in_map(domains_map_struct) != 64) {
+            errmsg("Sharded full count values error\n");
+        }
+
+        array_hashmap_del(&domains_map_struct);
+    }
+    /* Check sharded map */
+
+    /* Check foreach during resize */
+    {
+        memset(&opts, 0, sizeof(opts));
+        opts.flags = array_hashmap_opt_grow;
+        opts.migrate_step = 1;
+
+        domains_map_struct = array_hashmap_init_opts(1, 1.0, sizeof(domain_data_t), &opts);
+        visits = malloc(domains_map_size * sizeof(int32_t));
+        if (domains_map_struct == NULL || visits == NULL) {
+            errmsg("Init foreach during resize error\n");
+        }
+
+        array_hashmap_set_func(domains_map_struct, domain_add_hash, domain_add_cmp,
+                               domain_find_hash, domain_find_cmp, domain_find_hash,
+                               domain_find_cmp);
+
+        for (i = 0; i < domains_map_size / 2; i++) {
+            add_elem.domain_pos = domain_offsets[i];
+            add_elem.time = i;
+
+            add_res = array_hashmap_add_elem(domains_map_struct, &add_elem, NULL,
+                                             array_hashmap_save_old_func);
+            if (add_res != array_hashmap_elem_added) {
+                errmsg("Foreach during resize add values error\n");
             }
+        }
+
+        /* The other half is added by a thread, so the map grows and migrates during foreach */
+        resize_add_done = 0;
+        if (pthread_create(&thread, NULL, resize_add_thread_func, NULL)) {
+            errmsg("Can't create resize_add_thread\n");
+        }
+
+        do {
+            memset(visits, 0, domains_map_size * sizeof(int32_t));
+            array_hashmap_foreach(domains_map_struct, domain_visit_func, visits);
+
             for (i = 0; i < domains_map_size; i++) {
-                domain = &domains_random[domain_offsets[i]];
-                find_res = array_hashmap_find_elem(domains_map_struct, domain, &find_elem);
-                if (find_res != array_hashmap_elem_not_finded) {
-                    errmsg("array_hashmap: Check that everything is deleted error\n");
+                if (visits[i] > 1 || (i < domains_map_size / 2 && visits[i] != 1)) {
+                    errmsg("Foreach during resize visit error\n");
                 }
             }
-            if (array_hashmap_now_in_map(domains_map_struct) != 0) {
-                errmsg("array_hashmap: Check that everything is deleted error\n");
+        } while (!__atomic_load_n(&resize_add_done, __ATOMIC_ACQUIRE));
+
+        if (pthread_join(thread, NULL)) {
+            errmsg("Can't join resize_add_thread\n");
+        }
+
+        if (array_hashmap_now_in_map(domains_map_struct) != domains_map_size) {
+            errmsg("Foreach during resize count error\n");
+        }
+
+        free(visits);
+        array_hashmap_del(&domains_map_struct);
+    }
+    /* Check foreach during resize */
+
+    /* Check optimistic read */
+    {
+        memset(&opts, 0, sizeof(opts));
+        opts.flags = array_hashmap_opt_optimistic_read | array_hashmap_opt_grow;
+        opts.migrate_step = 1;
+
+        domains_map_struct = array_hashmap_init_opts(1, 1.0, sizeof(domain_data_t), &opts);
+        if (domains_map_struct == NULL) {
+            errmsg("Init optimistic read error\n");
+        }
+
+        array_hashmap_set_func(domains_map_struct, domain_add_hash, domain_add_cmp,
+                               domain_find_hash, domain_find_cmp_clamped, domain_find_hash,
+                               domain_find_cmp);
+
+        for (i = 0; i < domains_map_size / 4; i++) {
+            add_elem.domain_pos = domain_offsets[i];
+            add_elem.time = i;
+
+            add_res = array_hashmap_add_elem(domains_map_struct, &add_elem, NULL,
+                                             array_hashmap_save_old_func);
+            if (add_res != array_hashmap_elem_added) {
+                errmsg("Optimistic read add values error\n");
+            }
+        }
+
+        /* The rest is added and deleted under the readers, the map grows and elements move */
+        optimistic_write_done = 0;
+        for (i = 0; i < OPTIMISTIC_READERS; i++) {
+            if (pthread_create(&reader_threads[i], NULL, optimistic_find_thread_func, NULL)) {
+                errmsg("Can't create optimistic_find_thread %d\n", i);
             }
-            /* Check that everything is deleted */
+        }
 
-            /* Add values */
-            for (i = 0; i < domains_map_size; i++) {
+        for (write_round = 0; write_round < 4; write_round++) {
+            for (i = domains_map_size / 4; i < domains_map_size; i++) {
                 add_elem.domain_pos = domain_offsets[i];
-                add_elem.time = SECOND_TEST_TIME;
+                add_elem.time = i;
 
                 add_res = array_hashmap_add_elem(domains_map_struct, &add_elem, NULL,
                                                  array_hashmap_save_old_func);
                 if (add_res != array_hashmap_elem_added) {
-                    errmsg("array_hashmap: Add values error\n");
+                    errmsg("Optimistic read add values during reads error\n");
                 }
             }
-            /* Add values */
-
-            /* Delete everything at once */
-            TIMER_START();
-            del_elem_by_func_res =
-                array_hashmap_del_elem_by_func(domains_map_struct, domain_del_func);
-            if (del_elem_by_func_res != domains_map_size) {
-                errmsg("array_hashmap: Delete everything at once error\n");
-            }
-            TIMER_END();
-            /* Delete everything at once */
 
-            /* Check that everything is deleted */
-            for (i = 0; i < domains_map_size; i++) {
+            for (i = domains_map_size / 4; i < domains_map_size; i++) {
                 domain = &domains[domain_offsets[i]];
-                find_res = array_hashmap_find_elem(domains_map_struct, domain, &find_elem);
-                if (find_res != array_hashmap_elem_not_finded) {
-                    errmsg("array_hashmap: Check that everything is deleted error\n");
-                }
-            }
-            for (i = 0; i < domains_map_size; i++) {
-                domain = &domains_random[domain_offsets[i]];
-                find_res = array_hashmap_find_elem(domains_map_struct, domain, &find_elem);
-                if (find_res != array_hashmap_elem_not_finded) {
-                    errmsg("array_hashmap: Check that everything is deleted error\n");
+                if (array_hashmap_del_elem(domains_map_struct, domain, NULL) !=
+                    array_hashmap_elem_deled) {
+                    errmsg("Optimistic read delete values during reads error\n");
                 }
             }
-            if (array_hashmap_now_in_map(domains_map_struct) != 0) {
-                errmsg("array_hashmap: Check that everything is deleted error\n");
+        }
+        __atomic_store_n(&optimistic_write_done, 1, __ATOMIC_RELEASE);
+
+        for (i = 0; i < OPTIMISTIC_READERS; i++) {
+            if (pthread_join(reader_threads[i], NULL)) {
+                errmsg("Can't join optimistic_find_thread %d\n", i);
             }
-            /* Check that everything is deleted */
+        }
 
-            /* Destroy */
-            array_hashmap_del(&domains_map_struct);
-            /* Destroy */
+        if (array_hashmap_now_in_map(domains_map_struct) != domains_map_size / 4) {
+            errmsg("Optimistic read count error\n");
+        }
 
-            /* Time statistics*/
-            print_format = (int32_t)(strlen(print_data[0]) - 1);
-            printf("%*d;", print_format, (int32_t)(step * 100));
-            print_format = (int32_t)(strlen(print_data[1]) - 1);
-            printf("%*.*f;", print_format, 2, (double)mem_array / (1024.0 * 1024.0));
-            for (i = 0; i < time_index; i++) {
-                print_format = (int32_t)(strlen(print_data[i + 2]) - 1);
-                printf("%*d;", print_format, one_op_time_ns[i]);
-            }
-            printf("\n");
-            fflush(stdout);
-            /* Time statistics*/
+        array_hashmap_del(&domains_map_struct);
+    }
+    /* Check optimistic read */
+
+    /* Check expiring map */
+    {
+        memset(&opts, 0, sizeof(opts));
+        opts.flags = array_hashmap_opt_ttl;
+
+        domains_map_struct =
+            array_hashmap_init_opts(domains_map_size, 1.0, sizeof(domain_data_t), &opts);
+        if (domains_map_struct == NULL) {
+            errmsg("Init expiring error\n");
         }
 
-        printf("\n");
+        array_hashmap_set_func(domains_map_struct, domain_add_hash, domain_add_cmp,
+                               domain_find_hash, domain_find_cmp, domain_find_hash,
+                               domain_find_cmp);
+        array_hashmap_set_time_func(domains_map_struct, domain_time);
+
+        expire_now = FIRST_TEST_TIME;
+        for (i = 0; i < domains_map_size; i++) {
+            add_elem.domain_pos = domain_offsets[i];
+            add_elem.time = FIRST_TEST_TIME;
+
+            add_res = array_hashmap_add_elem_expire(
+                domains_map_struct, &add_elem, NULL, array_hashmap_save_old_func,
+                i % 2 ? SECOND_TEST_TIME : array_hashmap_no_expire);
+            if (add_res != array_hashmap_elem_added) {
+                errmsg("Expiring add values error\n");
+            }
+        }
+
+        expire_now = SECOND_TEST_TIME;
+        for (i = 0; i < domains_map_size; i++) {
+            domain = &domains[domain_offsets[i]];
+            find_res = array_hashmap_find_elem(domains_map_struct, domain, &find_elem);
+            if (find_res != (i % 2 ? array_hashmap_elem_not_finded : array_hashmap_elem_finded)) {
+                errmsg("Expiring check that expired values are not found error\n");
+            }
+        }
+
+        for (i = 1; i < domains_map_size; i += 2) {
+            add_elem.domain_pos = domain_offsets[i];
+            add_elem.time = SECOND_TEST_TIME;
+
+            add_res = array_hashmap_add_elem(domains_map_struct, &add_elem, NULL,
+                                             array_hashmap_save_old_func);
+            if (add_res != array_hashmap_elem_added) {
+                errmsg("Expiring add values in place of expired error\n");
+            }
+        }
+
+        if (array_hashmap_now_in_map(domains_map_struct) != domains_map_size) {
+            errmsg("Expiring check that expired values are replaced error\n");
+        }
+
+        /* An upsert of an element that is in sets its expiry time too */
+        upsert_count = 0;
+        for (i = 0; i < domains_map_size; i++) {
+            add_elem.domain_pos = domain_offsets[i];
+            add_elem.time = 0;
+
+            add_res = array_hashmap_upsert_expire(domains_map_struct, &add_elem,
+                                                  domain_upsert_init, domain_upsert_update,
+                                                  &upsert_count, SECOND_TEST_TIME + 1);
+            if (add_res != array_hashmap_elem_already_in) {
+                errmsg("Expiring upsert values error\n");
+            }
+        }
+
+        expire_now = SECOND_TEST_TIME + 1;
+        for (i = 0; i < domains_map_size; i++) {
+            add_elem.domain_pos = domain_offsets[i];
+            add_elem.time = 0;
+
+            add_res = array_hashmap_upsert_expire(domains_map_struct, &add_elem,
+                                                  domain_upsert_init, domain_upsert_update,
+                                                  &upsert_count, SECOND_TEST_TIME + 2);
+            if (add_res != array_hashmap_elem_added) {
+                errmsg("Expiring upsert in place of expired error\n");
+            }
+        }
+
+        for (i = 0; i < domains_map_size; i++) {
+            domain = &domains[domain_offsets[i]];
+            find_res = array_hashmap_find_elem(domains_map_struct, domain, &find_elem);
+            if (find_res != array_hashmap_elem_finded || find_elem.time != 1) {
+                errmsg("Expiring upsert find error\n");
+            }
+        }
+
+        expire_now = SECOND_TEST_TIME + 2;
+        if (upsert_count != domains_map_size ||
+            array_hashmap_find_elem(domains_map_struct, &domains[domain_offsets[0]], NULL) !=
+                array_hashmap_elem_not_finded) {
+            errmsg("Expiring upsert expiry error\n");
+        }
+
+        array_hashmap_del(&domains_map_struct);
+
+        /* A full map takes new keys in place of expired elements in other cells */
+        map_size = domains_map_size / 2;
+        domains_map_struct = array_hashmap_init_opts(map_size, 1.0, sizeof(domain_data_t), &opts);
+        if (domains_map_struct == NULL) {
+            errmsg("Init full expiring error\n");
+        }
+
+        array_hashmap_set_func(domains_map_struct, domain_add_hash, domain_add_cmp,
+                               domain_find_hash, domain_find_cmp, domain_find_hash,
+                               domain_find_cmp);
+        array_hashmap_set_time_func(domains_map_struct, domain_time);
+
+        expire_now = FIRST_TEST_TIME;
+        for (i = 0; i < map_size; i++) {
+            add_elem.domain_pos = domain_offsets[i];
+            add_elem.time = FIRST_TEST_TIME;
+
+            add_res = array_hashmap_add_elem_expire(domains_map_struct, &add_elem, NULL,
+                                                    array_hashmap_save_old_func, SECOND_TEST_TIME);
+            if (add_res != array_hashmap_elem_added) {
+                errmsg("Full expiring add values error\n");
+            }
+        }
+
+        expire_now = SECOND_TEST_TIME;
+        for (i = map_size; i < map_size * 2; i++) {
+            add_elem.domain_pos = domain_offsets[i];
+            add_elem.time = SECOND_TEST_TIME;
+
+            add_res = array_hashmap_add_elem(domains_map_struct, &add_elem, NULL,
+                                             array_hashmap_save_old_func);
+            if (add_res != array_hashmap_elem_added) {
+                errmsg("Full expiring add values in place of expired error\n");
+            }
+        }
+
+        for (i = map_size; i < map_size * 2; i++) {
+            domain = &domains[domain_offsets[i]];
+            find_res = array_hashmap_find_elem(domains_map_struct, domain, &find_elem);
+            if (find_res != array_hashmap_elem_finded || find_elem.time != SECOND_TEST_TIME) {
+                errmsg("Full expiring find error\n");
+            }
+        }
+
+        array_hashmap_del(&domains_map_struct);
+    }
+    /* Check expiring map */
+
+    /* Check snapshot */
+    {
+        domains_map_struct = array_hashmap_init(domains_map_size, 1.0, sizeof(domain_data_t));
+        if (domains_map_struct == NULL) {
+            errmsg("Init snapshot error\n");
+        }
+
+        array_hashmap_set_func(domains_map_struct, domain_add_hash, domain_add_cmp,
+                               domain_find_hash, domain_find_cmp, domain_find_hash,
+                               domain_find_cmp);
+
+        for (i = 0; i < domains_map_size; i++) {
+            add_elem.domain_pos = domain_offsets[i];
+            add_elem.time = FIRST_TEST_TIME;
+
+            add_res = array_hashmap_add_elem(domains_map_struct, &add_elem, NULL,
+                                             array_hashmap_save_old_func);
+            if (add_res != array_hashmap_elem_added) {
+                errmsg("Snapshot add values error\n");
+            }
+        }
+
+        if (array_hashmap_save(domains_map_struct, SNAPSHOT_PATH, SNAPSHOT_HASH_ID) != 1) {
+            errmsg("Snapshot save error\n");
+        }
+
+        array_hashmap_del(&domains_map_struct);
+
+        domains_map_struct = array_hashmap_open_mmap(SNAPSHOT_PATH, SNAPSHOT_HASH_ID);
+        if (domains_map_struct == NULL) {
+            errmsg("Snapshot open error\n");
+        }
+
+        array_hashmap_set_func(domains_map_struct, domain_add_hash, domain_add_cmp,
+                               domain_find_hash, domain_find_cmp, domain_find_hash,
+                               domain_find_cmp);
+
+        for (i = 0; i < domains_map_size; i++) {
+            domain = &domains[domain_offsets[i]];
+            find_res = array_hashmap_find_elem(domains_map_struct, domain, &find_elem);
+            if (find_res != array_hashmap_elem_finded || find_elem.time != FIRST_TEST_TIME) {
+                errmsg("Snapshot check that all values are loaded error\n");
+            }
+        }
+
+        array_hashmap_del(&domains_map_struct);
+
+        domains_map_struct = array_hashmap_open_mmap_checked(SNAPSHOT_PATH, SNAPSHOT_HASH_ID);
+        if (domains_map_struct == NULL) {
+            errmsg("Snapshot open checked error\n");
+        }
+
+        array_hashmap_del(&domains_map_struct);
+
+        /* The last byte of the file is in the array of the last shard */
+        snapshot_file = fopen(SNAPSHOT_PATH, "r+b");
+        if (snapshot_file == NULL || fseek(snapshot_file, -1, SEEK_END)) {
+            errmsg("Snapshot damage open error\n");
+        }
+
+        snapshot_byte = fgetc(snapshot_file);
+        if (snapshot_byte == EOF || fseek(snapshot_file, -1, SEEK_END) ||
+            fputc(snapshot_byte ^ 0xff, snapshot_file) == EOF || fclose(snapshot_file)) {
+            errmsg("Snapshot damage error\n");
+        }
+
+        if (array_hashmap_open_mmap_checked(SNAPSHOT_PATH, SNAPSHOT_HASH_ID) != NULL) {
+            errmsg("Snapshot damaged array check error\n");
+        }
+
+        unlink(SNAPSHOT_PATH);
+    }
+    /* Check snapshot */
+
+    /* Check shared map */
+    {
+        shm_unlink(SHARED_NAME);
+        domains_map_struct = array_hashmap_init_shared(SHARED_NAME, domains_map_size, 1.0,
+                                                       sizeof(domain_data_t), NULL);
+        if (domains_map_struct == NULL) {
+            errmsg("Init shared error\n");
+        }
+
+        array_hashmap_set_func(domains_map_struct, domain_add_hash, domain_add_cmp,
+                               domain_find_hash, domain_find_cmp, domain_find_hash,
+                               domain_find_cmp);
+
+        for (i = 0; i < domains_map_size; i++) {
+            add_elem.domain_pos = domain_offsets[i];
+            add_elem.time = FIRST_TEST_TIME;
+
+            add_res = array_hashmap_add_elem(domains_map_struct, &add_elem, NULL,
+                                             array_hashmap_save_old_func);
+            if (add_res != array_hashmap_elem_added) {
+                errmsg("Shared add values error\n");
+            }
+        }
+
+        for (i = 0; i < domains_map_size; i++) {
+            domain = &domains[domain_offsets[i]];
+            find_res = array_hashmap_find_elem(domains_map_struct, domain, &find_elem);
+            if (find_res != array_hashmap_elem_finded || find_elem.time != FIRST_TEST_TIME) {
+                errmsg("Shared check that all values are inserted error\n");
+            }
+        }
+
+        array_hashmap_del(&domains_map_struct);
+        shm_unlink(SHARED_NAME);
+    }
+    /* Check shared map */
+
+    /* Check huge pages */
+    {
+        memset(&opts, 0, sizeof(opts));
+        opts.flags = array_hashmap_opt_huge_pages | array_hashmap_opt_populate |
+                     array_hashmap_opt_grow | array_hashmap_opt_shrink;
+        opts.engine = array_hashmap_engine_swiss;
+
+        domains_map_struct = array_hashmap_init_opts(64, 1.0, sizeof(domain_data_t), &opts);
+        if (domains_map_struct == NULL) {
+            errmsg("Init huge pages error\n");
+        }
+
+        array_hashmap_set_func(domains_map_struct, domain_add_hash, domain_add_cmp,
+                               domain_find_hash, domain_find_cmp, domain_find_hash,
+                               domain_find_cmp);
+
+        for (i = 0; i < domains_map_size; i++) {
+            add_elem.domain_pos = domain_offsets[i];
+            add_elem.time = FIRST_TEST_TIME;
+
+            add_res = array_hashmap_add_elem(domains_map_struct, &add_elem, NULL,
+                                             array_hashmap_save_old_func);
+            if (add_res != array_hashmap_elem_added) {
+                errmsg("Huge pages add values error\n");
+            }
+        }
+
+        for (i = 0; i < domains_map_size; i++) {
+            domain = &domains[domain_offsets[i]];
+            if (array_hashmap_del_elem(domains_map_struct, domain, NULL) !=
+                array_hashmap_elem_deled) {
+                errmsg("Huge pages delete error\n");
+            }
+        }
+
+        array_hashmap_del(&domains_map_struct);
+    }
+    /* Check huge pages */
+
+    /* Check stats */
+    {
+        memset(&opts, 0, sizeof(opts));
+        opts.flags = array_hashmap_opt_stats;
+
+        domains_map_struct = array_hashmap_init_opts(domains_map_size, 1.0,
+                                                     sizeof(domain_data_t), &opts);
+        if (domains_map_struct == NULL) {
+            errmsg("Init stats error\n");
+        }
+
+        array_hashmap_set_func(domains_map_struct, domain_add_hash, domain_add_cmp,
+                               domain_find_hash, domain_find_cmp, domain_find_hash,
+                               domain_find_cmp);
+
+        for (i = 0; i < domains_map_size; i++) {
+            add_elem.domain_pos = domain_offsets[i];
+            add_elem.time = FIRST_TEST_TIME;
+
+            add_res = array_hashmap_add_elem(domains_map_struct, &add_elem, NULL,
+                                             array_hashmap_save_old_func);
+            if (add_res != array_hashmap_elem_added) {
+                errmsg("Stats add values error\n");
+            }
+        }
+
+        for (i = 0; i < domains_map_size; i++) {
+            domain = &domains[domain_offsets[i]];
+            find_res = array_hashmap_find_elem(domains_map_struct, domain, NULL);
+            if (find_res != array_hashmap_elem_finded) {
+                errmsg("Stats check that all values are inserted error\n");
+            }
+        }
+
+        if (array_hashmap_get_stats(domains_map_struct, &stats) != 1 ||
+            stats.now_in_map != domains_map_size ||
+            stats.chain_count + stats.non_owner_count != domains_map_size ||
+            stats.find_cmp_calls < (uint64_t)domains_map_size) {
+            errmsg("Stats error\n");
+        }
+
+        array_hashmap_del(&domains_map_struct);
+    }
+    /* Check stats */
+
+    /* Check latency */
+    {
+        domains_map_struct = array_hashmap_init(domains_map_size, 1.0, sizeof(domain_data_t));
+        if (domains_map_struct == NULL) {
+            errmsg("Init latency error\n");
+        }
+
+        array_hashmap_set_func(domains_map_struct, domain_add_hash, domain_add_cmp,
+                               domain_find_hash, domain_find_cmp, domain_find_hash,
+                               domain_find_cmp);
+
+        for (i = 0; i < domains_map_size; i++) {
+            add_elem.domain_pos = domain_offsets[i];
+            add_elem.time = FIRST_TEST_TIME;
+
+            add_res = array_hashmap_add_elem(domains_map_struct, &add_elem, NULL,
+                                             array_hashmap_save_old_func);
+            if (add_res != array_hashmap_elem_added) {
+                errmsg("Latency add values error\n");
+            }
+        }
+
+        if (array_hashmap_get_latency(domains_map_struct, &latency) == 1 &&
+            (latency.count[array_hashmap_latency_add] != (uint64_t)domains_map_size ||
+             latency.count[array_hashmap_latency_find] != 0 ||
+             array_hashmap_latency_percentile(&latency, array_hashmap_latency_add, 50) >
+                 array_hashmap_latency_percentile(&latency, array_hashmap_latency_add, 99))) {
+            errmsg("Latency error\n");
+        }
+
+        array_hashmap_del(&domains_map_struct);
+    }
+    /* Check latency */
+
+    /* Check split data */
+    {
+        memset(&opts, 0, sizeof(opts));
+        opts.flags = array_hashmap_opt_split_data | array_hashmap_opt_store_hash |
+                     array_hashmap_opt_grow | array_hashmap_opt_shrink;
+        opts.engine = array_hashmap_engine_swiss;
+
+        if (array_hashmap_init_opts(64, 1.0, sizeof(domain_data_t), &opts) != NULL) {
+            errmsg("Split data swiss error\n");
+        }
+
+        opts.engine = array_hashmap_engine_chain;
+
+        domains_map_struct = array_hashmap_init_opts(64, 1.0, sizeof(domain_data_t), &opts);
+        if (domains_map_struct == NULL) {
+            errmsg("Init split data error\n");
+        }
+
+        array_hashmap_set_func(domains_map_struct, domain_add_hash, domain_add_cmp,
+                               domain_find_hash, domain_find_cmp, domain_find_hash,
+                               domain_find_cmp);
+
+        for (i = 0; i < domains_map_size; i++) {
+            add_elem.domain_pos = domain_offsets[i];
+            add_elem.time = i;
+
+            add_res = array_hashmap_add_elem(domains_map_struct, &add_elem, NULL,
+                                             array_hashmap_save_old_func);
+            if (add_res != array_hashmap_elem_added) {
+                errmsg("Split data add values error\n");
+            }
+        }
+
+        for (i = 0; i < domains_map_size; i++) {
+            domain = &domains[domain_offsets[i]];
+            find_res = array_hashmap_find_elem(domains_map_struct, domain, &find_elem);
+            if (find_res != array_hashmap_elem_finded || find_elem.time != i) {
+                errmsg("Split data find error\n");
+            }
+        }
+
+        for (i = 0; i < domains_map_size; i++) {
+            domain = &domains[domain_offsets[i]];
+            if (array_hashmap_del_elem(domains_map_struct, domain, NULL) !=
+                array_hashmap_elem_deled) {
+                errmsg("Split data delete error\n");
+            }
+        }
+
+        array_hashmap_del(&domains_map_struct);
+    }
+    /* Check split data */
+
+    /* Check lease */
+    {
+        domains_map_struct = array_hashmap_init(domains_map_size, 1.0, sizeof(domain_data_t));
+        if (domains_map_struct == NULL) {
+            errmsg("Init lease error\n");
+        }
+
+        array_hashmap_set_func(domains_map_struct, domain_add_hash, domain_add_cmp,
+                               domain_find_hash, domain_find_cmp, domain_find_hash,
+                               domain_find_cmp);
+
+        for (i = 0; i < domains_map_size / 2; i++) {
+            add_elem.domain_pos = domain_offsets[i];
+            add_elem.time = i;
+
+            add_res = array_hashmap_add_elem(domains_map_struct, &add_elem, NULL,
+                                             array_hashmap_save_old_func);
+            if (add_res != array_hashmap_elem_added) {
+                errmsg("Lease add values error\n");
+            }
+        }
+
+        for (i = 0; i < domains_map_size; i++) {
+            domain = &domains[domain_offsets[i]];
+            find_res = array_hashmap_find_lease(domains_map_struct, domain, &lease);
+            if (i < domains_map_size / 2) {
+                if (find_res != array_hashmap_elem_finded ||
+                    ((const domain_data_t *)lease.elem_data)->time != i) {
+                    errmsg("Lease find error\n");
+                }
+            } else if (find_res != array_hashmap_elem_not_finded || lease.elem_data) {
+                errmsg("Lease find non-inserted error\n");
+            }
+            array_hashmap_lease_release(&lease);
+
+            if (lease.elem_data) {
+                errmsg("Lease release error\n");
+            }
+        }
+
+        for (i = 0; i < domains_map_size / 2; i++) {
+            domain = &domains[domain_offsets[i]];
+            if (array_hashmap_del_elem(domains_map_struct, domain, NULL) !=
+                array_hashmap_elem_deled) {
+                errmsg("Lease delete error\n");
+            }
+        }
+
+        array_hashmap_del(&domains_map_struct);
+    }
+    /* Check lease */
+
+    /* Check upsert */
+    {
+        domains_map_struct = array_hashmap_init(domains_map_size, 1.0, sizeof(domain_data_t));
+        if (domains_map_struct == NULL) {
+            errmsg("Init upsert error\n");
+        }
+
+        array_hashmap_set_func(domains_map_struct, domain_add_hash, domain_add_cmp,
+                               domain_find_hash, domain_find_cmp, domain_find_hash,
+                               domain_find_cmp);
+
+        upsert_count = 0;
+        for (upsert_round = 0; upsert_round < 3; upsert_round++) {
+            for (i = 0; i < domains_map_size; i++) {
+                add_elem.domain_pos = domain_offsets[i];
+                add_elem.time = 0;
+
+                add_res = array_hashmap_upsert(domains_map_struct, &add_elem, domain_upsert_init,
+                                               domain_upsert_update, &upsert_count);
+                if (add_res != (upsert_round ? array_hashmap_elem_already_in
+                                             : array_hashmap_elem_added)) {
+                    errmsg("Upsert values error\n");
+                }
+            }
+        }
+
+        if (upsert_count != 2 * domains_map_size) {
+            errmsg("Upsert update count error\n");
+        }
+
+        for (i = 0; i < domains_map_size; i++) {
+            domain = &domains[domain_offsets[i]];
+            find_res = array_hashmap_find_elem(domains_map_struct, domain, &find_elem);
+            if (find_res != array_hashmap_elem_finded || find_elem.time != 3) {
+                errmsg("Upsert find error\n");
+            }
+        }
+
+        array_hashmap_del(&domains_map_struct);
+    }
+    /* Check upsert */
+
+    /* Check hash functions */
+    {
+        memset(&opts, 0, sizeof(opts));
+        opts.hash_func = (array_hashmap_hash_func_t)2;
+
+        if (array_hashmap_init_opts(64, 1.0, sizeof(domain_data_t), &opts) != NULL) {
+            errmsg("Hash function check error\n");
+        }
+
+        opts.hash_func = array_hashmap_hash_crc32c;
+        opts.seed = 1;
+
+        domains_map_struct = array_hashmap_init_opts(64, 1.0, sizeof(domain_data_t), &opts);
+        seed_map_struct[0] = array_hashmap_init_opts(64, 1.0, sizeof(domain_data_t), &opts);
+
+        opts.seed = 0;
+
+        seed_map_struct[1] = array_hashmap_init_opts(64, 1.0, sizeof(domain_data_t), &opts);
+        if (!domains_map_struct || !seed_map_struct[0] || !seed_map_struct[1]) {
+            errmsg("Init hash functions error\n");
+        }
+
+        hash_diff = 0;
+        for (i = 0; i < domains_map_size; i++) {
+            domain = &domains[domain_offsets[i]];
+            if (array_hashmap_hash_str(domains_map_struct, domain) !=
+                    array_hashmap_hash_bytes(seed_map_struct[0], domain, strlen(domain)) ||
+                array_hashmap_hash_str(domains_map_struct, domain) !=
+                    array_hashmap_hash_seed(array_hashmap_hash_crc32c, 1, domain, strlen(domain))) {
+                errmsg("Hash same seed error\n");
+            }
+            if (array_hashmap_hash_str(domains_map_struct, domain) !=
+                array_hashmap_hash_str(seed_map_struct[1], domain)) {
+                hash_diff++;
+            }
+        }
+
+        if (hash_diff < domains_map_size / 2) {
+            errmsg("Hash random seed error\n");
+        }
+
+        array_hashmap_del(&seed_map_struct[0]);
+        array_hashmap_del(&seed_map_struct[1]);
+        array_hashmap_del(&domains_map_struct);
+
+        memset(&opts, 0, sizeof(opts));
+        opts.key_size = sizeof(domain_data_t) + 1;
+
+        if (array_hashmap_init_opts(64, 1.0, sizeof(domain_data_t), &opts) != NULL) {
+            errmsg("Key size check error\n");
+        }
+
+        /* The key is domain_pos, no functions are set */
+        opts.key_size = sizeof(uint32_t);
+        opts.hash_func = array_hashmap_hash_crc32c;
+
+        domains_map_struct = array_hashmap_init_opts(domains_map_size, 1.0,
+                                                     sizeof(domain_data_t), &opts);
+        if (domains_map_struct == NULL) {
+            errmsg("Init key size error\n");
+        }
+
+        for (i = 0; i < domains_map_size; i++) {
+            add_elem.domain_pos = domain_offsets[i];
+            add_elem.time = i;
+
+            add_res = array_hashmap_add_elem(domains_map_struct, &add_elem, NULL,
+                                             array_hashmap_save_old_func);
+            if (add_res != array_hashmap_elem_added) {
+                errmsg("Key size add values error\n");
+            }
+        }
+
+        for (i = 0; i < domains_map_size; i++) {
+            add_elem.domain_pos = domain_offsets[i];
+
+            find_res = array_hashmap_find_elem(domains_map_struct, &add_elem, &find_elem);
+            if (find_res != array_hashmap_elem_finded || find_elem.time != i) {
+                errmsg("Key size find error\n");
+            }
+
+            if (array_hashmap_del_elem(domains_map_struct, &add_elem, NULL) !=
+                array_hashmap_elem_deled) {
+                errmsg("Key size delete error\n");
+            }
+        }
+
+        array_hashmap_del(&domains_map_struct);
+
+        /* The key is a pointer to a NUL-terminated string, found by a pointer to the pointer */
+        opts.key_size = array_hashmap_key_cstr;
+        opts.hash_func = array_hashmap_hash_wy;
+
+        domains_map_struct = array_hashmap_init_opts(domains_map_size, 1.0,
+                                                     sizeof(domain_ptr_t), &opts);
+        if (domains_map_struct == NULL) {
+            errmsg("Init string key function error\n");
+        }
+
+        for (i = 0; i < domains_map_size; i++) {
+            ptr_elem.domain = &domains[domain_offsets[i]];
+            ptr_elem.time = i;
+
+            add_res = array_hashmap_add_elem(domains_map_struct, &ptr_elem, NULL,
+                                             array_hashmap_save_old_func);
+            if (add_res != array_hashmap_elem_added) {
+                errmsg("String key function add values error\n");
+            }
+        }
+
+        if (array_hashmap_save(domains_map_struct, SNAPSHOT_PATH, SNAPSHOT_HASH_ID)) {
+            errmsg("String key function save error\n");
+        }
+
+        for (i = 0; i < domains_map_size; i++) {
+            domain = &domains[domain_offsets[i]];
+
+            find_res = array_hashmap_find_elem(domains_map_struct, &domain, &ptr_elem);
+            if (find_res != array_hashmap_elem_finded || ptr_elem.time != i ||
+                ptr_elem.domain != domain) {
+                errmsg("String key function find error\n");
+            }
+
+            if (array_hashmap_del_elem(domains_map_struct, &domain, NULL) !=
+                array_hashmap_elem_deled) {
+                errmsg("String key function delete error\n");
+            }
+        }
+
+        array_hashmap_del(&domains_map_struct);
+    }
+    /* Check hash functions */
+
+    /* Check string keys */
+    {
+        memset(&opts, 0, sizeof(opts));
+        opts.flags = array_hashmap_opt_str_key | array_hashmap_opt_optimistic_read;
+
+        if (array_hashmap_init_opts(64, 1.0, sizeof(domain_str_t), &opts) != NULL) {
+            errmsg("String keys optimistic read error\n");
+        }
+
+        opts.flags = array_hashmap_opt_str_key | array_hashmap_opt_grow;
+
+        domains_map_struct = array_hashmap_init_opts(64, 1.0, sizeof(domain_str_t), &opts);
+        if (domains_map_struct == NULL) {
+            errmsg("Init string keys error\n");
+        }
+
+        for (i = 0; i < domains_map_size; i++) {
+            domain = domain_str(i, short_domain);
+            array_hashmap_str_set(domains_map_struct, &str_elem.domain, domain, strlen(domain));
+            str_elem.time = i;
+
+            add_res = array_hashmap_add_elem(domains_map_struct, &str_elem, NULL,
+                                             array_hashmap_save_old_func);
+            if (add_res != array_hashmap_elem_added) {
+                errmsg("String keys add values error\n");
+            }
+        }
+
+        if (array_hashmap_save(domains_map_struct, SNAPSHOT_PATH, SNAPSHOT_HASH_ID)) {
+            errmsg("String keys snapshot error\n");
+        }
+
+        if (array_hashmap_del_elem_by_func(domains_map_struct, domain_str_del_func) !=
+            domains_map_size - (domains_map_size + 7) / 8) {
+            errmsg("String keys delete by func error\n");
+        }
+
+        for (i = 0; i < domains_map_size; i++) {
+            domain = domain_str(i, short_domain);
+            array_hashmap_str_set(domains_map_struct, &str_key, domain, strlen(domain));
+
+            find_res = array_hashmap_find_elem(domains_map_struct, &str_key, &str_elem);
+            if (i % 8) {
+                if (find_res != array_hashmap_elem_not_finded) {
+                    errmsg("String keys find deleted error\n");
+                }
+            } else if (find_res != array_hashmap_elem_finded || str_elem.time != i ||
+                       str_elem.domain.len != strlen(domain) ||
+                       memcmp(array_hashmap_str_key(&str_elem.domain), domain,
+                              str_elem.domain.len)) {
+                errmsg("String keys find error\n");
+            }
+        }
+
+        for (i = 0; i < domains_map_size; i += 8) {
+            domain = domain_str(i, short_domain);
+            array_hashmap_str_set(domains_map_struct, &str_key, domain, strlen(domain));
+
+            if (array_hashmap_del_elem(domains_map_struct, &str_key, NULL) !=
+                array_hashmap_elem_deled) {
+                errmsg("String keys delete error\n");
+            }
+        }
+
+        if (array_hashmap_now_in_map(domains_map_struct) != 0) {
+            errmsg("String keys delete all error\n");
+        }
+
+        array_hashmap_del(&domains_map_struct);
+    }
+    /* Check string keys */
+
+    /* Check cuckoo */
+    {
+        memset(&opts, 0, sizeof(opts));
+        opts.flags = array_hashmap_opt_split_data;
+        opts.engine = array_hashmap_engine_cuckoo;
+
+        if (array_hashmap_init_opts(64, 1.0, sizeof(domain_data_t), &opts) != NULL) {
+            errmsg("Split data cuckoo error\n");
+        }
+
+        opts.flags = array_hashmap_opt_store_hash | array_hashmap_opt_stats;
+
+        domains_map_struct = array_hashmap_init_opts(domains_map_size / CUCKOO_MAX_LOAD, 1.0,
+                                                     sizeof(domain_data_t), &opts);
+        if (domains_map_struct == NULL) {
+            errmsg("Init cuckoo error\n");
+        }
+
+        array_hashmap_set_func(domains_map_struct, domain_add_hash, domain_add_cmp,
+                               domain_find_hash, domain_find_cmp, domain_find_hash,
+                               domain_find_cmp);
+
+        for (i = 0; i < domains_map_size; i++) {
+            add_elem.domain_pos = domain_offsets[i];
+            add_elem.time = FIRST_TEST_TIME + i % 2;
+
+            add_res = array_hashmap_add_elem(domains_map_struct, &add_elem, NULL,
+                                             array_hashmap_save_old_func);
+            if (add_res != array_hashmap_elem_added) {
+                errmsg("Cuckoo add values error\n");
+            }
+        }
+
+        if (array_hashmap_get_stats(domains_map_struct, &stats) != 1 ||
+            stats.chain_count != domains_map_size || stats.chain_max > 3 ||
+            stats.displacements == 0) {
+            errmsg("Cuckoo stats error\n");
+        }
+
+        if (array_hashmap_del_elem_by_func(domains_map_struct, domain_del_func) !=
+            domains_map_size / 2) {
+            errmsg("Cuckoo delete by func error\n");
+        }
+
+        for (i = 0; i < domains_map_size; i++) {
+            domain = &domains[domain_offsets[i]];
+            find_res = array_hashmap_find_elem(domains_map_struct, domain, &find_elem);
+            if (find_res != (i % 2 ? array_hashmap_elem_not_finded : array_hashmap_elem_finded)) {
+                errmsg("Cuckoo find after delete error\n");
+            }
+        }
+
+        for (i = 1; i < domains_map_size; i += 2) {
+            add_elem.domain_pos = domain_offsets[i];
+            add_elem.time = i;
+
+            add_res = array_hashmap_add_elem(domains_map_struct, &add_elem, NULL,
+                                             array_hashmap_save_old_func);
+            if (add_res != array_hashmap_elem_added) {
+                errmsg("Cuckoo add again error\n");
+            }
+        }
+
+        for (i = 0; i < domains_map_size; i++) {
+            domain = &domains[domain_offsets[i]];
+            find_res = array_hashmap_find_elem(domains_map_struct, domain, &find_elem);
+            if (find_res != array_hashmap_elem_finded ||
+                find_elem.time != (i % 2 ? i : FIRST_TEST_TIME)) {
+                errmsg("Cuckoo find error\n");
+            }
+        }
+
+        array_hashmap_del(&domains_map_struct);
+    }
+    /* Check cuckoo */
+
+    /* Check cuckoo resize */
+    {
+        added_count = 0;
+        finded_count = 0;
+        skipped_count = 0;
+
+        memset(&opts, 0, sizeof(opts));
+        opts.flags = array_hashmap_opt_grow | array_hashmap_opt_shrink |
+                     array_hashmap_opt_store_hash;
+        opts.engine = array_hashmap_engine_cuckoo;
+        opts.migrate_step = 1;
+
+        domains_map_struct = array_hashmap_init_opts(64, 1.0, sizeof(domain_data_t), &opts);
+        if (domains_map_struct == NULL) {
+            errmsg("Init cuckoo resize error\n");
+        }
+
+        array_hashmap_set_func(domains_map_struct, domain_collide_hash, domain_add_cmp,
+                               domain_collide_hash, domain_add_cmp, domain_collide_hash,
+                               domain_add_cmp);
+
+        /* Elements with time -1 have one hash, two buckets and the stash take 24 of them */
+        for (i = 0; i < 24; i++) {
+            add_elem.domain_pos = domain_offsets[i];
+            add_elem.time = -1;
+
+            add_res = array_hashmap_add_elem(domains_map_struct, &add_elem, NULL,
+                                             array_hashmap_save_old_func);
+            if (add_res != array_hashmap_elem_added) {
+                errmsg("Cuckoo resize add colliding error\n");
+            }
+        }
+
+        map_size = array_hashmap_map_size(domains_map_struct);
+        for (i = 56; array_hashmap_map_size(domains_map_struct) == map_size; i++) {
+            add_elem.domain_pos = domain_offsets[i];
+            add_elem.time = i;
+
+            add_res = array_hashmap_add_elem(domains_map_struct, &add_elem, NULL,
+                                             array_hashmap_save_old_func);
+
+            /* A key with the buckets of the colliding ones fits only after the map grows */
+            if (add_res == array_hashmap_full) {
+                skipped_count++;
+                swap_offset = domain_offsets[i];
+                domain_offsets[i] = domain_offsets[domains_map_size - skipped_count];
+                domain_offsets[domains_map_size - skipped_count] = swap_offset;
+                i--;
+            } else if (add_res != array_hashmap_elem_added) {
+                errmsg("Cuckoo resize add values error\n");
+            }
+        }
+        map_size = i;
+
+        /* New colliding elements take the new array before the old ones are moved */
+        for (i = 24; i < 56; i++) {
+            add_elem.domain_pos = domain_offsets[i];
+            add_elem.time = -1;
+
+            add_res = array_hashmap_add_elem(domains_map_struct, &add_elem, NULL,
+                                             array_hashmap_save_old_func);
+            if (add_res == array_hashmap_elem_added) {
+                added_count++;
+            } else if (add_res != array_hashmap_full) {
+                errmsg("Cuckoo resize add more colliding error\n");
+            }
+        }
+
+        if (added_count == 32 ||
+            array_hashmap_now_in_map(domains_map_struct) != map_size - 32 + added_count ||
+            array_hashmap_save(domains_map_struct, SNAPSHOT_PATH, SNAPSHOT_HASH_ID)) {
+            errmsg("Cuckoo resize stopped migration error\n");
+        }
+
+        for (i = 0; i < 56; i++) {
+            add_elem.domain_pos = domain_offsets[i];
+            add_elem.time = -1;
+
+            find_res = array_hashmap_find_elem(domains_map_struct, &add_elem, NULL);
+            if (find_res == array_hashmap_elem_finded) {
+                finded_count++;
+            } else if (i < 24) {
+                errmsg("Cuckoo resize find colliding error\n");
+            }
+
+            if (array_hashmap_del_elem(domains_map_struct, &add_elem, NULL) != find_res) {
+                errmsg("Cuckoo resize delete colliding error\n");
+            }
+        }
+
+        if (finded_count != 24 + added_count ||
+            !array_hashmap_save(domains_map_struct, SNAPSHOT_PATH, SNAPSHOT_HASH_ID)) {
+            errmsg("Cuckoo resize continued migration error\n");
+        }
+        unlink(SNAPSHOT_PATH);
+
+        for (i = 56; i < map_size; i++) {
+            add_elem.domain_pos = domain_offsets[i];
+            add_elem.time = i;
+
+            find_res = array_hashmap_find_elem(domains_map_struct, &add_elem, &find_elem);
+            if (find_res != array_hashmap_elem_finded || find_elem.time != i) {
+                errmsg("Cuckoo resize find error\n");
+            }
+
+            if (array_hashmap_del_elem(domains_map_struct, &add_elem, NULL) !=
+                array_hashmap_elem_deled) {
+                errmsg("Cuckoo resize delete error\n");
+            }
+        }
+
+        if (array_hashmap_now_in_map(domains_map_struct) != 0) {
+            errmsg("Cuckoo resize delete all error\n");
+        }
+
+        array_hashmap_del(&domains_map_struct);
+    }
+    /* Check cuckoo resize */
+
+    for (thread_count = 1; thread_count <= 8; thread_count++) {
+        domains_map_size = domains_map_size_all - domains_map_size_all % thread_count;
+        shard_count = thread_count % 2 ? 1 : 8;
+        printf("Domains count: %d\n", domains_map_size);
+        printf("Threads count: %d\n", thread_count);
+        printf("Shards count: %d\n", shard_count);
+        printf("\n");
+
+        for (engine = array_hashmap_engine_chain; engine <= array_hashmap_engine_cuckoo;
+             engine++) {
+            printf("array_hashmap %s\n", engine_names[engine]);
+            for (i = 0; i < 11; i++) {
+                printf("%s", print_data[i]);
+            }
+            printf("\n");
+
+            for (step = 1.00; step > 0.5; step -= 0.01) {
+                if (engine == array_hashmap_engine_swiss && step > SWISS_MAX_LOAD) {
+                    continue;
+                }
+                if (engine == array_hashmap_engine_cuckoo && step > CUCKOO_MAX_LOAD) {
+                    continue;
+                }
+
+                time_index = 0;
+
+                /* Get memory usage */
+                mem_base = heap_in_use();
+                /* Get memory usage */
+
+                /* Init */
+                memset(&opts, 0, sizeof(opts));
+                opts.engine = engine;
+                opts.shard_count = shard_count;
+                /* Shards are uneven, the fuller ones grow instead of returning full */
+                if (shard_count > 1) {
+                    opts.flags = array_hashmap_opt_grow | array_hashmap_opt_store_hash;
+                }
+
+                domains_map_struct = array_hashmap_init_opts(domains_map_size / step, 1.0,
+                                                             sizeof(domain_data_t), &opts);
+                if (domains_map_struct == NULL) {
+                    errmsg("array_hashmap: Init error\n");
+                }
+
+                array_hashmap_set_func(domains_map_struct, domain_add_hash, domain_add_cmp,
+                                       domain_find_hash, domain_find_cmp, domain_find_hash,
+                                       domain_find_cmp);
+                /* Init */
+
+                /* Add values */
+                RUN_THREAD(add);
+                /* Add values */
+
+                /* Get memory usage */
+                mem_array = heap_in_use() - mem_base;
+                /* Get memory usage */
+
+                /* Check that all values are inserted */
+                RUN_THREAD(find);
+                /* Check that all values are inserted */
+
+                /* Check that all values are inserted by batch */
+                RUN_THREAD(find_batch);
+                /* Check that all values are inserted by batch */
+
+                /* Check that there are no non-inserted elements */
+                RUN_THREAD(no_find);
+                /* Check that there are no non-inserted elements */
+
+                /* Update values */
+                RUN_THREAD(update);
+                /* Update values */
+
+                /* Check the updated values */
+                RUN_THREAD(check_update);
+                /* Check the updated values */
+
+                /* Visit all values */
+                foreach_count = 0;
+                RUN_THREAD(foreach);
+                if (foreach_count != domains_map_size) {
+                    errmsg("array_hashmap: Visit all values error\n");
+                }
+                /* Visit all values */
+
+                /* Delete everything individually */
+                RUN_THREAD(del);
+                /* Delete everything individually */
+
+                /* Check that everything is deleted */
+                for (i = 0; i < domains_map_size; i++) {
+                    domain = &domains[domain_offsets[i]];
+                    find_res = array_hashmap_find_elem(domains_map_struct, domain, &find_elem);
+                    if (find_res != array_hashmap_elem_not_finded) {
+                        errmsg("array_hashmap: Check that everything is deleted error\n");
+                    }
+                }
+                for (i = 0; i < domains_map_size; i++) {
+                    domain = &domains_random[domain_offsets[i]];
+                    find_res = array_hashmap_find_elem(domains_map_struct, domain, &find_elem);
+                    if (find_res != array_hashmap_elem_not_finded) {
+                        errmsg("array_hashmap: Check that everything is deleted error\n");
+                    }
+                }
+                if (array_hashmap_now_in_map(domains_map_struct) != 0) {
+                    errmsg("array_hashmap: Check that everything is deleted error\n");
+                }
+                /* Check that everything is deleted */
+
+                /* Add values */
+                for (i = 0; i < domains_map_size; i++) {
+                    add_elem.domain_pos = domain_offsets[i];
+                    add_elem.time = SECOND_TEST_TIME;
+
+                    add_res = array_hashmap_add_elem(domains_map_struct, &add_elem, NULL,
+                                                     array_hashmap_save_old_func);
+                    if (add_res != array_hashmap_elem_added) {
+                        errmsg("array_hashmap: Add values error\n");
+                    }
+                }
+                /* Add values */
+
+                /* Delete everything at once */
+                TIMER_START();
+                del_elem_by_func_res = array_hashmap_del_elem_by_func_parallel(
+                    domains_map_struct, domain_del_func, thread_count);
+                if (del_elem_by_func_res != domains_map_size) {
+                    errmsg("array_hashmap: Delete everything at once error\n");
+                }
+                TIMER_END();
+                /* Delete everything at once */
+
+                /* Check that everything is deleted */
+                for (i = 0; i < domains_map_size; i++) {
+                    domain = &domains[domain_offsets[i]];
+                    find_res = array_hashmap_find_elem(domains_map_struct, domain, &find_elem);
+                    if (find_res != array_hashmap_elem_not_finded) {
+                        errmsg("array_hashmap: Check that everything is deleted error\n");
+                    }
+                }
+                for (i = 0; i < domains_map_size; i++) {
+                    domain = &domains_random[domain_offsets[i]];
+                    find_res = array_hashmap_find_elem(domains_map_struct, domain, &find_elem);
+                    if (find_res != array_hashmap_elem_not_finded) {
+                        errmsg("array_hashmap: Check that everything is deleted error\n");
+                    }
+                }
+                if (array_hashmap_now_in_map(domains_map_struct) != 0) {
+                    errmsg("array_hashmap: Check that everything is deleted error\n");
+                }
+                /* Check that everything is deleted */
+
+                /* Destroy */
+                array_hashmap_del(&domains_map_struct);
+                /* Destroy */
+
+                /* Time statistics*/
+                print_format = (int32_t)(strlen(print_data[0]) - 1);
+                printf("%*d;", print_format, (int32_t)(step * 100));
+                print_format = (int32_t)(strlen(print_data[1]) - 1);
+                printf("%*.*f;", print_format, 2, (double)mem_array / (1024.0 * 1024.0));
+                for (i = 0; i < time_index; i++) {
+                    print_format = (int32_t)(strlen(print_data[i + 2]) - 1);
+                    printf("%*d;", print_format, one_op_time_ns[i]);
+                }
+                printf("\n");
+                fflush(stdout);
+                /* Time statistics*/
+            }
+
+            printf("\n");
+        }
     }
 
     free(domains);
@@ -0,0 +1,462 @@
+#include "array_hashmap.hpp"
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <sys/time.h>
+
+#define KEYS_COUNT (1 << 22)
+#define FIRST_TEST_TIME 10
+#define SECOND_TEST_TIME 100
+#define CHECK_MAP_SIZE 1024
+
+typedef struct domain_data {
+    uint32_t domain_pos;
+    int32_t time;
+} domain_data_t;
+
+typedef struct key_data {
+    uint32_t key;
+    domain_data_t data;
+} key_data_t;
+
+uint32_t *keys = NULL;
+uint32_t *keys_random = NULL;
+
+void errmsg(const char *format, ...)
+{
+    va_list args;
+
+    printf("Error: ");
+
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+
+    exit(EXIT_FAILURE);
+}
+
+array_hashmap_hash key_hash(const void *elem_data)
+{
+    const key_data_t *elem = (const key_data_t *)elem_data;
+    return elem->key;
+}
+
+array_hashmap_bool key_cmp(const void *elem_data, const void *hashmap_elem_data)
+{
+    const key_data_t *elem1 = (const key_data_t *)elem_data;
+    const key_data_t *elem2 = (const key_data_t *)hashmap_elem_data;
+
+    return elem1->key == elem2->key;
+}
+
+struct key_hash_functor {
+    array_hashmap_hash operator()(uint32_t key) const
+    {
+        return key;
+    }
+};
+
+/* Value with a heap buffer whose copy throws when asked, moves do not throw */
+struct throw_value {
+    std::string str;
+    static int32_t throw_countdown;
+
+    explicit throw_value(const std::string &str) : str(str)
+    {
+    }
+
+    throw_value(const throw_value &other) : str(other.str)
+    {
+        if (throw_countdown > 0 && --throw_countdown == 0) {
+            throw std::runtime_error("throw_value: copy");
+        }
+    }
+
+    throw_value(throw_value &&other) noexcept = default;
+    throw_value &operator=(const throw_value &other) = default;
+    throw_value &operator=(throw_value &&other) noexcept = default;
+};
+
+int32_t throw_value::throw_countdown = 0;
+
+std::string value_str(uint32_t key, int32_t time)
+{
+    return "value of key " + std::to_string(key) + " at time " + std::to_string(time);
+}
+
+void random_permutation(uint32_t *arr, int32_t size)
+{
+    int32_t i = 0;
+    int32_t j = 0;
+    uint32_t tmp = 0;
+
+    for (i = size - 1; i > 0; i--) {
+        j = rand() % (i + 1);
+        tmp = arr[i];
+        arr[i] = arr[j];
+        arr[j] = tmp;
+    }
+}
+
+#define TIMER_START()                             \
+    {                                             \
+        random_permutation(keys, KEYS_COUNT);     \
+        gettimeofday(&now_timeval_start, NULL);   \
+    }
+
+#define TIMER_END()                                                                         \
+    {                                                                                       \
+        gettimeofday(&now_timeval_end, NULL);                                               \
+        now_us_start = now_timeval_start.tv_sec * 1000000 + now_timeval_start.tv_usec;      \
+        now_us_end = now_timeval_end.tv_sec * 1000000 + now_timeval_end.tv_usec;            \
+        one_op_time_ns[time_index++] = ((now_us_end - now_us_start) * 1000) / KEYS_COUNT;   \
+    }
+
+int32_t main(void)
+{
+    int32_t i = 0;
+    double step = 0;
+
+    key_data_t elem;
+    key_data_t res_elem;
+    const domain_data_t *find_data = NULL;
+
+    struct timeval now_timeval_start;
+    struct timeval now_timeval_end;
+
+    uint64_t now_us_start;
+    uint64_t now_us_end;
+
+    int32_t time_index = 0;
+    int32_t one_op_time_ns[100];
+
+    int32_t print_format = 0;
+    const char *print_data[100];
+
+    int32_t api = 0;
+    const char *api_names[2];
+
+    array_hashmap_t map_struct = NULL;
+
+    print_data[0] = "Load %;";
+    print_data[1] = "Insert;";
+    print_data[2] = "Lookup hit;";
+    print_data[3] = "Lookup miss;";
+    print_data[4] = "Update;";
+    print_data[5] = "Delete each;";
+
+    api_names[0] = "array_hashmap C API";
+    api_names[1] = "array_hashmap C++ template";
+
+    srand(time(NULL));
+
+    /* Gen keys */
+    {
+        keys = (uint32_t *)malloc(KEYS_COUNT * sizeof(uint32_t));
+        keys_random = (uint32_t *)malloc(KEYS_COUNT * sizeof(uint32_t));
+        if (keys == NULL || keys_random == NULL) {
+            errmsg("No free memory for keys\n");
+        }
+
+        for (i = 0; i < KEYS_COUNT; i++) {
+            keys[i] = (uint32_t)i * 2654435761u;
+            keys_random[i] = (uint32_t)(i + KEYS_COUNT) * 2654435761u;
+        }
+    }
+    /* Gen keys */
+
+    /* Check values with a heap buffer */
+    {
+        array_hashmap<uint32_t, std::string, key_hash_functor> map(CHECK_MAP_SIZE, 1.0);
+        std::string value;
+        std::string res_value;
+        const std::string *find_value = NULL;
+        array_hashmap_deled_count del_count = 0;
+
+        /* A full map displaces foreign elements and makes long lists */
+        for (i = 0; i < CHECK_MAP_SIZE; i++) {
+            value = value_str(keys[i], FIRST_TEST_TIME);
+            if (map.add_elem(keys[i], value) != array_hashmap_elem_added) {
+                errmsg("C++ template: String add values error\n");
+            }
+        }
+
+        if (map.add_elem(keys_random[0], value) != array_hashmap_full) {
+            errmsg("C++ template: String full map error\n");
+        }
+
+        for (i = 0; i < CHECK_MAP_SIZE; i += 2) {
+            if (map.add_elem(keys[i], value_str(keys[i], SECOND_TEST_TIME),
+                             [](const std::string &, const std::string &) { return true; }) !=
+                array_hashmap_elem_already_in) {
+                errmsg("C++ template: String update values error\n");
+            }
+        }
+
+        for (i = 0; i < CHECK_MAP_SIZE; i++) {
+            find_value = map.find_elem(keys[i]);
+            if (find_value == NULL ||
+                *find_value != value_str(keys[i], i % 2 ? FIRST_TEST_TIME : SECOND_TEST_TIME)) {
+                errmsg("C++ template: String find values error\n");
+            }
+        }
+
+        for (i = 0; i < CHECK_MAP_SIZE; i += 4) {
+            if (map.del_elem(keys[i], &res_value) != array_hashmap_elem_deled ||
+                res_value != value_str(keys[i], SECOND_TEST_TIME)) {
+                errmsg("C++ template: String delete error\n");
+            }
+        }
+
+        del_count = map.del_elem_by_func([](const uint32_t &, const std::string &str) {
+            return str.find(" at time " + std::to_string(SECOND_TEST_TIME)) !=
+                   std::string::npos;
+        });
+        if (del_count != CHECK_MAP_SIZE / 4 || map.get_now_in_map() != CHECK_MAP_SIZE / 2) {
+            errmsg("C++ template: String delete by function error\n");
+        }
+
+        for (i = 0; i < CHECK_MAP_SIZE; i++) {
+            find_value = map.find_elem(keys[i]);
+            if ((find_value != NULL) != (i % 2 == 1) ||
+                (find_value != NULL && *find_value != value_str(keys[i], FIRST_TEST_TIME))) {
+                errmsg("C++ template: String values after delete error\n");
+            }
+        }
+    }
+    /* Check values with a heap buffer */
+
+    /* Check values whose copy throws */
+    {
+        array_hashmap<uint32_t, throw_value, key_hash_functor> map(CHECK_MAP_SIZE, 1.0);
+        int32_t added_count = 0;
+        const throw_value *find_value = NULL;
+
+        /* Every third add throws, also after a foreign element is displaced from the cell */
+        for (i = 0; i < CHECK_MAP_SIZE; i++) {
+            throw_value value(value_str(keys[i], FIRST_TEST_TIME));
+
+            throw_value::throw_countdown = i % 3 ? 0 : 1;
+            try {
+                if (map.add_elem(keys[i], value) == array_hashmap_elem_added) {
+                    added_count++;
+                }
+            } catch (const std::runtime_error &) {
+                if (i % 3) {
+                    errmsg("C++ template: Throwing add unexpected throw error\n");
+                }
+            }
+            throw_value::throw_countdown = 0;
+        }
+
+        if (map.get_now_in_map() != added_count || added_count != CHECK_MAP_SIZE * 2 / 3) {
+            errmsg("C++ template: Throwing add values error\n");
+        }
+
+        for (i = 0; i < CHECK_MAP_SIZE; i++) {
+            find_value = map.find_elem(keys[i]);
+            if ((find_value != NULL) != (i % 3 != 0) ||
+                (find_value != NULL && find_value->str != value_str(keys[i], FIRST_TEST_TIME))) {
+                errmsg("C++ template: Throwing add find error\n");
+            }
+        }
+    }
+    /* Check values whose copy throws */
+
+    printf("Keys count: %d\n", KEYS_COUNT);
+    printf("\n");
+
+    for (api = 0; api < 2; api++) {
+        printf("%s\n", api_names[api]);
+        for (i = 0; i < 6; i++) {
+            printf("%s", print_data[i]);
+        }
+        printf("\n");
+
+        for (step = 1.00; step > 0.5; step -= 0.05) {
+            time_index = 0;
+
+            if (api == 0) {
+                /* Init */
+                map_struct = array_hashmap_init(KEYS_COUNT / step, 1.0, sizeof(key_data_t));
+                if (map_struct == NULL) {
+                    errmsg("C API: Init error\n");
+                }
+
+                array_hashmap_set_func(map_struct, key_hash, key_cmp, key_hash, key_cmp, key_hash,
+                                       key_cmp);
+                /* Init */
+
+                /* Add values */
+                TIMER_START();
+                for (i = 0; i < KEYS_COUNT; i++) {
+                    elem.key = keys[i];
+                    elem.data.domain_pos = i;
+                    elem.data.time = FIRST_TEST_TIME;
+                    if (array_hashmap_add_elem(map_struct, &elem, NULL,
+                                               array_hashmap_save_old_func) !=
+                        array_hashmap_elem_added) {
+                        errmsg("C API: Add values error\n");
+                    }
+                }
+                TIMER_END();
+                /* Add values */
+
+                /* Check that all values are inserted */
+                TIMER_START();
+                for (i = 0; i < KEYS_COUNT; i++) {
+                    elem.key = keys[i];
+                    if (array_hashmap_find_elem(map_struct, &elem, &res_elem) !=
+                            array_hashmap_elem_finded ||
+                        res_elem.data.time != FIRST_TEST_TIME) {
+                        errmsg("C API: Check that all values are inserted error\n");
+                    }
+                }
+                TIMER_END();
+                /* Check that all values are inserted */
+
+                /* Check that there are no non-inserted elements */
+                TIMER_START();
+                for (i = 0; i < KEYS_COUNT; i++) {
+                    elem.key = keys_random[i];
+                    if (array_hashmap_find_elem(map_struct, &elem, &res_elem) !=
+                        array_hashmap_elem_not_finded) {
+                        errmsg("C API: Check that there are no non-inserted elements error\n");
+                    }
+                }
+                TIMER_END();
+                /* Check that there are no non-inserted elements */
+
+                /* Update values */
+                TIMER_START();
+                for (i = 0; i < KEYS_COUNT; i++) {
+                    elem.key = keys[i];
+                    elem.data.domain_pos = i;
+                    elem.data.time = SECOND_TEST_TIME;
+                    if (array_hashmap_add_elem(map_struct, &elem, NULL,
+                                               array_hashmap_save_new_func) !=
+                        array_hashmap_elem_already_in) {
+                        errmsg("C API: Update values error\n");
+                    }
+                }
+                TIMER_END();
+                /* Update values */
+
+                /* Delete everything individually */
+                TIMER_START();
+                for (i = 0; i < KEYS_COUNT; i++) {
+                    elem.key = keys[i];
+                    if (array_hashmap_del_elem(map_struct, &elem, &res_elem) !=
+                            array_hashmap_elem_deled ||
+                        res_elem.data.time != SECOND_TEST_TIME) {
+                        errmsg("C API: Delete everything individually error\n");
+                    }
+                }
+                TIMER_END();
+                /* Delete everything individually */
+
+                if (array_hashmap_now_in_map(map_struct) != 0) {
+                    errmsg("C API: Check that everything is deleted error\n");
+                }
+
+                /* Destroy */
+                array_hashmap_del(&map_struct);
+                /* Destroy */
+            } else {
+                /* Init */
+                array_hashmap<uint32_t, domain_data_t, key_hash_functor> map(KEYS_COUNT / step,
+                                                                             1.0);
+                domain_data_t data;
+                domain_data_t res_data;
+                /* Init */
+
+                /* Add values */
+                TIMER_START();
+                for (i = 0; i < KEYS_COUNT; i++) {
+                    data.domain_pos = i;
+                    data.time = FIRST_TEST_TIME;
+                    if (map.add_elem(keys[i], data) != array_hashmap_elem_added) {
+                        errmsg("C++ template: Add values error\n");
+                    }
+                }
+                TIMER_END();
+                /* Add values */
+
+                /* Check that all values are inserted */
+                TIMER_START();
+                for (i = 0; i < KEYS_COUNT; i++) {
+                    find_data = map.find_elem(keys[i]);
+                    if (find_data == NULL || find_data->time != FIRST_TEST_TIME) {
+                        errmsg("C++ template: Check that all values are inserted error\n");
+                    }
+                }
+                TIMER_END();
+                /* Check that all values are inserted */
+
+                /* Check that there are no non-inserted elements */
+                TIMER_START();
+                for (i = 0; i < KEYS_COUNT; i++) {
+                    if (map.find_elem(keys_random[i]) != NULL) {
+                        errmsg("C++ template: Check that there are no non-inserted elements "
+                               "error\n");
+                    }
+                }
+                TIMER_END();
+                /* Check that there are no non-inserted elements */
+
+                /* Update values */
+                TIMER_START();
+                for (i = 0; i < KEYS_COUNT; i++) {
+                    data.domain_pos = i;
+                    data.time = SECOND_TEST_TIME;
+                    if (map.add_elem(keys[i], data,
+                                     [](const domain_data_t &, const domain_data_t &) {
+                                         return true;
+                                     }) != array_hashmap_elem_already_in) {
+                        errmsg("C++ template: Update values error\n");
+                    }
+                }
+                TIMER_END();
+                /* Update values */
+
+                /* Delete everything individually */
+                TIMER_START();
+                for (i = 0; i < KEYS_COUNT; i++) {
+                    if (map.del_elem(keys[i], &res_data) != array_hashmap_elem_deled ||
+                        res_data.time != SECOND_TEST_TIME) {
+                        errmsg("C++ template: Delete everything individually error\n");
+                    }
+                }
+                TIMER_END();
+                /* Delete everything individually */
+
+                if (map.get_now_in_map() != 0) {
+                    errmsg("C++ template: Check that everything is deleted error\n");
+                }
+            }
+
+            /* Time statistics*/
+            print_format = (int32_t)(strlen(print_data[0]) - 1);
+            printf("%*d;", print_format, (int32_t)(step * 100 + 0.5));
+            for (i = 0; i < time_index; i++) {
+                print_format = (int32_t)(strlen(print_data[i + 1]) - 1);
+                printf("%*d;", print_format, one_op_time_ns[i]);
+            }
+            printf("\n");
+            fflush(stdout);
+            /* Time statistics*/
+        }
+
+        printf("\n");
+    }
+
+    free(keys);
+    free(keys_random);
+
+    printf("Success\n");
+    return EXIT_SUCCESS;
+}